@@ -0,0 +1,193 @@
+#include "harness.h"
+
+#include "device.h"
+#include "script.h"
+
+#include <algorithm>
+#include <cmath>
+#include <memory>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QPointer>
+#include <QTimer>
+
+BenchmarkReport::BenchmarkReport(QString name) :
+    m_name(name)
+{
+}
+
+void BenchmarkReport::setParameter(QString key, QJsonValue value)
+{
+    m_parameters[key] = value;
+}
+
+void BenchmarkReport::addMetric(QString key, double value, QString unit)
+{
+    m_metrics[key] = QJsonObject {
+        { "value", value },
+        { "unit", unit },
+    };
+}
+
+static double percentile(const QList<double> &sorted, double p)
+{
+    auto index = static_cast<qsizetype>(std::ceil(p * sorted.size())) - 1;
+    return sorted[qBound<qsizetype>(0, index, sorted.size() - 1)];
+}
+
+void BenchmarkReport::addSamples(QString key, QList<double> samples, QString unit)
+{
+    if (samples.isEmpty())
+        return;
+
+    std::sort(samples.begin(), samples.end());
+
+    double sum = 0;
+    for (double sample : std::as_const(samples))
+        sum += sample;
+
+    m_metrics[key] = QJsonObject {
+        { "unit", unit },
+        { "count", samples.size() },
+        { "min", samples.first() },
+        { "mean", sum / samples.size() },
+        { "p50", percentile(samples, 0.50) },
+        { "p90", percentile(samples, 0.90) },
+        { "p99", percentile(samples, 0.99) },
+        { "max", samples.last() },
+    };
+}
+
+void BenchmarkReport::fail(QString message)
+{
+    m_error = message;
+}
+
+QJsonObject BenchmarkReport::toJson() const
+{
+    QJsonObject result {
+        { "benchmark", m_name },
+        { "version", QString(FRIDAQML_VERSION) },
+        { "parameters", m_parameters },
+        { "metrics", m_metrics },
+    };
+    if (!m_error.isEmpty())
+        result["error"] = m_error;
+    return result;
+}
+
+TargetProcess::TargetProcess(QString program) :
+    m_program(program)
+{
+}
+
+TargetProcess::~TargetProcess()
+{
+    if (m_process.state() == QProcess::NotRunning)
+        return;
+
+    m_process.kill();
+    m_process.waitForFinished();
+}
+
+bool TargetProcess::start()
+{
+    m_process.start(m_program, QStringList());
+    return m_process.waitForStarted();
+}
+
+BenchmarkOptions::BenchmarkOptions(const QStringList &args)
+{
+    for (const QString &arg : args) {
+        if (!arg.startsWith("--")) {
+            m_target = arg;
+            continue;
+        }
+
+        auto separator = arg.indexOf('=');
+        if (separator == -1)
+            m_values[arg.mid(2)] = QString();
+        else
+            m_values[arg.mid(2, separator - 2)] = arg.mid(separator + 1);
+    }
+}
+
+int BenchmarkOptions::intValue(QString name, int defaultValue) const
+{
+    bool valid;
+    auto value = m_values.value(name).toInt(&valid);
+    return valid ? value : defaultValue;
+}
+
+double BenchmarkOptions::doubleValue(QString name, double defaultValue) const
+{
+    bool valid;
+    auto value = m_values.value(name).toDouble(&valid);
+    return valid ? value : defaultValue;
+}
+
+bool BenchmarkOptions::flag(QString name) const
+{
+    return m_values.contains(name);
+}
+
+bool waitUntil(std::function<bool ()> condition, int timeout)
+{
+    QElapsedTimer timer;
+    timer.start();
+
+    // Wakes the loop up regularly so the timeout is noticed while idle.
+    QTimer tick;
+    tick.start(10);
+
+    while (!condition()) {
+        if (timer.elapsed() >= timeout)
+            return false;
+        QCoreApplication::processEvents(QEventLoop::AllEvents | QEventLoop::WaitForMoreEvents);
+    }
+
+    return true;
+}
+
+Script *createScript(QByteArray code, QObject *parent)
+{
+    auto script = new Script(parent);
+    script->setName("benchmark");
+    script->setCode(code);
+    waitUntil([=] () { return script->status() != Script::Status::Loading; });
+    return script;
+}
+
+ScriptInstance *injectScript(Device *device, Script *script, int pid, QString *errorMessage)
+{
+    QPointer<ScriptInstance> instance = device->inject(script, pid);
+    if (instance.isNull()) {
+        *errorMessage = "Unable to inject";
+        return nullptr;
+    }
+
+    auto lastError = std::make_shared<QString>();
+    QObject::connect(instance, &ScriptInstance::error, instance, [=] (QString message) { *lastError = message; });
+
+    bool settled = waitUntil([=] () {
+        if (instance.isNull())
+            return true;
+        auto status = instance->status();
+        return status == ScriptInstance::Status::Started || status == ScriptInstance::Status::Error
+            || status == ScriptInstance::Status::Destroyed;
+    });
+
+    if (!settled || instance.isNull() || instance->status() != ScriptInstance::Status::Started) {
+        *errorMessage = lastError->isEmpty() ? QString("Script did not start") : *lastError;
+        return nullptr;
+    }
+
+    return instance;
+}
+
+void stopScript(Script *script)
+{
+    script->stop();
+    waitUntil([=] () { return script->instances().isEmpty(); });
+}
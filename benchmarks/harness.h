@@ -0,0 +1,85 @@
+#ifndef FRIDAQML_BENCHMARKS_HARNESS_H
+#define FRIDAQML_BENCHMARKS_HARNESS_H
+
+#include <functional>
+#include <QHash>
+#include <QJsonArray>
+#include <QJsonObject>
+#include <QList>
+#include <QProcess>
+#include <QString>
+#include <QStringList>
+
+class Device;
+class Script;
+class ScriptInstance;
+
+// Collects the parameters and results of one benchmark run, emitted as a
+// single JSON object so runs can be compared across releases.
+class BenchmarkReport
+{
+public:
+    explicit BenchmarkReport(QString name);
+
+    void setParameter(QString key, QJsonValue value);
+    void addMetric(QString key, double value, QString unit);
+    void addSamples(QString key, QList<double> samples, QString unit);
+    void fail(QString message);
+
+    bool hasFailed() const { return !m_error.isEmpty(); }
+    QJsonObject toJson() const;
+
+private:
+    QString m_name;
+    QJsonObject m_parameters;
+    QJsonObject m_metrics;
+    QString m_error;
+};
+
+// A helper process on the local system for agents to be injected into.
+class TargetProcess
+{
+public:
+    explicit TargetProcess(QString program);
+    ~TargetProcess();
+
+    bool start();
+    int pid() const { return static_cast<int>(m_process.processId()); }
+
+private:
+    QString m_program;
+    QProcess m_process;
+};
+
+class BenchmarkOptions
+{
+public:
+    explicit BenchmarkOptions(const QStringList &args);
+
+    QString target() const { return m_target; }
+    int intValue(QString name, int defaultValue) const;
+    double doubleValue(QString name, double defaultValue) const;
+    bool flag(QString name) const;
+
+private:
+    QString m_target;
+    QHash<QString, QString> m_values;
+};
+
+typedef int (*BenchmarkFunction)(const BenchmarkOptions &options, BenchmarkReport *report);
+
+bool waitUntil(std::function<bool ()> condition, int timeout = 30000);
+Script *createScript(QByteArray code, QObject *parent = nullptr);
+ScriptInstance *injectScript(Device *device, Script *script, int pid, QString *errorMessage);
+void stopScript(Script *script);
+
+int runIconBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runInjectBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runInjectFloodBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runListModelBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runLoadBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runMessagesBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runPostBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+int runRpcBenchmark(const BenchmarkOptions &options, BenchmarkReport *report);
+
+#endif
@@ -0,0 +1,89 @@
+#include "harness.h"
+
+#include "iconprovider.h"
+
+#include <QBuffer>
+#include <QColor>
+#include <QElapsedTimer>
+#include <QImage>
+
+static QVariantMap createRgbaIcon(int size)
+{
+    QByteArray pixels(size * size * 4, '\0');
+    for (int i = 0; i != pixels.size(); i++)
+        pixels[i] = static_cast<char>(i * 31);
+
+    return QVariantMap {
+        { "format", "rgba" },
+        { "width", size },
+        { "height", size },
+        { "image", pixels },
+    };
+}
+
+static QVariantMap createPngIcon(int size)
+{
+    QImage image(size, size, QImage::Format_RGBA8888);
+    for (int y = 0; y != size; y++) {
+        for (int x = 0; x != size; x++)
+            image.setPixelColor(x, y, QColor::fromHsv((x * 360) / size, 255, (y * 255) / size));
+    }
+
+    QByteArray png;
+    QBuffer buffer(&png);
+    buffer.open(QIODevice::WriteOnly);
+    image.save(&buffer, "PNG");
+
+    return QVariantMap {
+        { "format", "png" },
+        { "image", png },
+    };
+}
+
+// Cost of IconProvider::requestImage() for the icon formats devices report,
+// at their native size and scaled to what a list delegate would ask for.
+int runIconBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int iterations = options.intValue("iterations", 2000);
+    report->setParameter("iterations", iterations);
+
+    auto provider = IconProvider::instance();
+
+    struct Case
+    {
+        const char *name;
+        QVariantMap icon;
+    };
+    const Case cases[] = {
+        { "rgba_16", createRgbaIcon(16) },
+        { "rgba_32", createRgbaIcon(32) },
+        { "png_128", createPngIcon(128) },
+    };
+
+    for (const Case &c : cases) {
+        auto icon = provider->add(c.icon);
+        auto id = QString::number(icon.id());
+
+        for (QSize requestedSize : { QSize(), QSize(24, 24) }) {
+            QList<double> samples;
+            for (int i = 0; i != iterations; i++) {
+                QElapsedTimer timer;
+                timer.start();
+                QSize size;
+                auto image = provider->requestImage(id, &size, requestedSize);
+                samples.append(timer.nsecsElapsed() / 1e3);
+                if (image.isNull()) {
+                    report->fail(QString("Failed to decode %1").arg(c.name));
+                    return 1;
+                }
+            }
+
+            auto key = QString(c.name).append(requestedSize.isValid() ? "_scaled" : "_native");
+            report->addSamples(key, samples, "us");
+        }
+
+        provider->remove(icon);
+    }
+
+    return 0;
+}
@@ -0,0 +1,48 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+
+// Time from inject() to the script reporting Started. The first injection
+// into the target includes attaching; later ones reuse the session.
+int runInjectBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int iterations = options.intValue("iterations", 20);
+    report->setParameter("iterations", iterations);
+
+    TargetProcess target(options.target());
+    if (!target.start()) {
+        report->fail("Unable to start target process");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+    auto script = createScript("/* nothing to do */");
+
+    QList<double> cold;
+    QList<double> warm;
+    for (int i = 0; i != iterations; i++) {
+        QElapsedTimer timer;
+        timer.start();
+
+        QString errorMessage;
+        if (injectScript(device, script, target.pid(), &errorMessage) == nullptr) {
+            report->fail(errorMessage);
+            break;
+        }
+        double elapsed = timer.nsecsElapsed() / 1e6;
+        (i == 0 ? cold : warm).append(elapsed);
+
+        stopScript(script);
+    }
+
+    report->addSamples("cold_inject_latency", cold, "ms");
+    report->addSamples("warm_inject_latency", warm, "ms");
+
+    delete script;
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+
+static const char *FloodAgent = R"(
+const payload = 'x'.repeat(1024);
+function flood() {
+  for (let i = 0; i !== 256; i++)
+    send(payload);
+  setTimeout(flood, 0);
+}
+flood();
+)";
+
+// Inject latency on one target while an agent in another target floods
+// Script.message, to show how much a noisy session holds up the others.
+int runInjectFloodBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int iterations = options.intValue("iterations", 20);
+    bool offload = options.flag("offload");
+    report->setParameter("iterations", iterations);
+    report->setParameter("offloadMessages", offload);
+
+    TargetProcess noisyTarget(options.target());
+    TargetProcess quietTarget(options.target());
+    if (!noisyTarget.start() || !quietTarget.start()) {
+        report->fail("Unable to start target processes");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+    auto flood = createScript(FloodAgent);
+    flood->setOffloadMessages(offload);
+    auto script = createScript("/* nothing to do */");
+
+    qint64 received = 0;
+    QObject::connect(flood, &Script::message, [&] (ScriptInstance *, QJsonObject, QVariant) {
+        received++;
+    });
+
+    QString errorMessage;
+    if (injectScript(device, flood, noisyTarget.pid(), &errorMessage) == nullptr) {
+        report->fail(errorMessage);
+        delete script;
+        delete flood;
+        return 1;
+    }
+    if (!waitUntil([&] () { return received != 0; })) {
+        report->fail("Flooding agent did not send anything");
+        stopScript(flood);
+        delete script;
+        delete flood;
+        return 1;
+    }
+
+    QElapsedTimer window;
+    window.start();
+    received = 0;
+
+    QList<double> cold;
+    QList<double> warm;
+    for (int i = 0; i != iterations; i++) {
+        QElapsedTimer timer;
+        timer.start();
+
+        if (injectScript(device, script, quietTarget.pid(), &errorMessage) == nullptr) {
+            report->fail(errorMessage);
+            break;
+        }
+        double elapsed = timer.nsecsElapsed() / 1e6;
+        (i == 0 ? cold : warm).append(elapsed);
+
+        stopScript(script);
+    }
+
+    report->addSamples("cold_inject_latency", cold, "ms");
+    report->addSamples("warm_inject_latency", warm, "ms");
+    report->addMetric("flood_messages_per_second", received / (window.nsecsElapsed() / 1e9), "msg/s");
+
+    stopScript(flood);
+    delete script;
+    delete flood;
+
+    return 0;
+}
@@ -0,0 +1,47 @@
+#include "harness.h"
+
+#include "processlistmodel.h"
+#include "syntheticprocesssource.h"
+
+#include <QElapsedTimer>
+
+// Initial load and incremental refreshes of ProcessListModel against a
+// synthetic process set, through the same diff and queued updateItems()
+// that a real device goes through.
+int runListModelBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int processCount = options.intValue("processes", 20000);
+    double churn = options.doubleValue("churn", 0.05);
+    int refreshes = options.intValue("refreshes", 20);
+    report->setParameter("processes", processCount);
+    report->setParameter("churn", churn);
+    report->setParameter("refreshes", refreshes);
+
+    ProcessListModel model;
+    bool inserted = false;
+    QObject::connect(&model, &QAbstractItemModel::rowsInserted, [&] () { inserted = true; });
+
+    QElapsedTimer timer;
+    timer.start();
+    model.setSyntheticSource(std::make_shared<SyntheticProcessSource>(processCount, churn));
+    if (!waitUntil([&] () { return model.count() == processCount; }, 120000)) {
+        report->fail("Timed out waiting for the initial load");
+        return 1;
+    }
+    report->addMetric("initial_load", timer.nsecsElapsed() / 1e6, "ms");
+
+    QList<double> samples;
+    for (int i = 0; i != refreshes; i++) {
+        inserted = false;
+        timer.restart();
+        model.refresh();
+        if (!waitUntil([&] () { return inserted; }, 60000)) {
+            report->fail("Timed out waiting for a refresh");
+            break;
+        }
+        samples.append(timer.nsecsElapsed() / 1e6);
+    }
+    report->addSamples("refresh", samples, "ms");
+
+    return 0;
+}
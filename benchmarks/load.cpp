@@ -0,0 +1,102 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTemporaryDir>
+#include <QUrl>
+
+// Writes an agent of roughly the given size, mostly a large string table
+// as bundlers tend to produce.
+static bool writeAgent(QString path, qint64 size)
+{
+    QFile file(path);
+    if (!file.open(QIODevice::WriteOnly))
+        return false;
+
+    QByteArray line("  '");
+    line.append(QByteArray(96, 'x'));
+    line.append("',\n");
+
+    file.write("const table = [\n");
+    for (qint64 written = 0; written < size; written += line.size())
+        file.write(line);
+    file.write("];\nsend(table.length);\n");
+
+    return file.error() == QFileDevice::NoError;
+}
+
+// Time from Script.url being set to the script reaching Loaded for a large
+// local agent, and from inject() to Started with that agent.
+int runLoadBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int sizeMegabytes = options.intValue("size", 10);
+    int iterations = options.intValue("iterations", 10);
+    report->setParameter("sizeMegabytes", sizeMegabytes);
+    report->setParameter("iterations", iterations);
+
+    QTemporaryDir directory;
+    if (!directory.isValid()) {
+        report->fail("Unable to create temporary directory");
+        return 1;
+    }
+
+    QList<QUrl> urls;
+    for (int i = 0; i != iterations; i++) {
+        auto path = directory.filePath(QString("agent-%1.js").arg(i));
+        if (!writeAgent(path, qint64(sizeMegabytes) * 1024 * 1024)) {
+            report->fail("Unable to write agent");
+            return 1;
+        }
+        urls.append(QUrl::fromLocalFile(path));
+    }
+
+    TargetProcess target(options.target());
+    if (!target.start()) {
+        report->fail("Unable to start target process");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+
+    QList<double> loadSamples;
+    QList<double> injectSamples;
+    for (const QUrl &url : std::as_const(urls)) {
+        Script script;
+        script.setName("benchmark");
+
+        QElapsedTimer timer;
+        timer.start();
+        double loadTime = -1;
+        QObject::connect(&script, &Script::statusChanged, [&] (Script::Status status) {
+            if (status == Script::Status::Loaded && loadTime < 0)
+                loadTime = timer.nsecsElapsed() / 1e6;
+        });
+
+        script.setUrl(url);
+        if (!waitUntil([&] () { return script.status() != Script::Status::Loading; })
+                || script.status() != Script::Status::Loaded) {
+            report->fail(QString("Unable to load “").append(url.toLocalFile()).append("”"));
+            break;
+        }
+        loadSamples.append(loadTime);
+
+        timer.restart();
+        QString errorMessage;
+        if (injectScript(device, &script, target.pid(), &errorMessage) == nullptr) {
+            report->fail(errorMessage);
+            break;
+        }
+        injectSamples.append(timer.nsecsElapsed() / 1e6);
+
+        stopScript(&script);
+    }
+
+    report->addSamples("load_latency", loadSamples, "ms");
+    report->addSamples("inject_latency", injectSamples, "ms");
+
+    return 0;
+}
@@ -0,0 +1,61 @@
+#include "harness.h"
+
+#include "frida.h"
+
+#include <cstdio>
+#include <QGuiApplication>
+#include <QJsonDocument>
+
+struct BenchmarkEntry
+{
+    const char *name;
+    BenchmarkFunction run;
+};
+
+static const BenchmarkEntry benchmarks[] = {
+    { "icon", runIconBenchmark },
+    { "inject", runInjectBenchmark },
+    { "inject-flood", runInjectFloodBenchmark },
+    { "list-model", runListModelBenchmark },
+    { "load", runLoadBenchmark },
+    { "messages", runMessagesBenchmark },
+    { "post", runPostBenchmark },
+    { "rpc", runRpcBenchmark },
+};
+
+int main(int argc, char *argv[])
+{
+    QGuiApplication app(argc, argv);
+
+    auto args = app.arguments();
+    if (args.size() < 2) {
+        std::fprintf(stderr, "Usage: %s <benchmark> [target] [--option=value...]\n", argv[0]);
+        return 1;
+    }
+
+    auto name = args[1];
+    BenchmarkFunction run = nullptr;
+    for (const BenchmarkEntry &entry : benchmarks) {
+        if (name == entry.name)
+            run = entry.run;
+    }
+    if (run == nullptr) {
+        std::fprintf(stderr, "Unknown benchmark: %s\n", qPrintable(name));
+        return 1;
+    }
+
+    // Sets up frida and the local device, which every benchmark relies on
+    // for its main context even when it does not inject anything.
+    auto frida = Frida::instance();
+
+    BenchmarkOptions options(args.mid(2));
+    BenchmarkReport report(name);
+    int status = run(options, &report);
+
+    std::printf("%s\n", QJsonDocument(report.toJson()).toJson(QJsonDocument::Compact).constData());
+    std::fflush(stdout);
+
+    delete frida;
+
+    return (status == 0 && !report.hasFailed()) ? 0 : 1;
+}
@@ -0,0 +1,82 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+
+static const char *FloodAgent = R"(
+recv('flood', function onFlood(message) {
+  const payload = 'x'.repeat(message.size);
+  for (let i = 0; i !== message.count; i++)
+    send(payload);
+  send({ done: true });
+  recv('flood', onFlood);
+});
+)";
+
+// Throughput of messages from an agent to Script.message, for a few payload
+// sizes, optionally with offloadMessages enabled.
+int runMessagesBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int count = options.intValue("count", 20000);
+    bool offload = options.flag("offload");
+    report->setParameter("count", count);
+    report->setParameter("offloadMessages", offload);
+
+    TargetProcess target(options.target());
+    if (!target.start()) {
+        report->fail("Unable to start target process");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+    auto script = createScript(FloodAgent);
+    script->setOffloadMessages(offload);
+
+    QString errorMessage;
+    auto instance = injectScript(device, script, target.pid(), &errorMessage);
+    if (instance == nullptr) {
+        report->fail(errorMessage);
+        delete script;
+        return 1;
+    }
+
+    int received = 0;
+    bool done = false;
+    QObject::connect(script, &Script::message, [&] (ScriptInstance *, QJsonObject object, QVariant) {
+        auto payload = object["payload"];
+        if (payload.isObject() && payload.toObject()["done"].toBool())
+            done = true;
+        else
+            received++;
+    });
+
+    for (int size : { 16, 1024, 16384 }) {
+        received = 0;
+        done = false;
+
+        QElapsedTimer timer;
+        timer.start();
+        instance->post(QJsonObject {
+            { "type", "flood" },
+            { "count", count },
+            { "size", size },
+        });
+        if (!waitUntil([&] () { return done; }, 120000)) {
+            report->fail(QString("Timed out waiting for %1-byte messages").arg(size));
+            break;
+        }
+        double seconds = timer.nsecsElapsed() / 1e9;
+
+        auto key = QString("size_%1").arg(size);
+        report->addMetric(key + "_messages_per_second", received / seconds, "msg/s");
+        report->addMetric(key + "_megabytes_per_second", received * double(size) / seconds / 1e6, "MB/s");
+    }
+
+    stopScript(script);
+    delete script;
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+
+static const char *EchoAgent = R"(
+recv('ping', function onPing(message) {
+  send(message.seq);
+  recv('ping', onPing);
+});
+)";
+
+// Round trip of Script.post() to an agent that replies right away.
+int runPostBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int iterations = options.intValue("iterations", 500);
+    report->setParameter("iterations", iterations);
+
+    TargetProcess target(options.target());
+    if (!target.start()) {
+        report->fail("Unable to start target process");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+    auto script = createScript(EchoAgent);
+
+    QString errorMessage;
+    auto instance = injectScript(device, script, target.pid(), &errorMessage);
+    if (instance == nullptr) {
+        report->fail(errorMessage);
+        delete script;
+        return 1;
+    }
+
+    int lastSeq = -1;
+    QObject::connect(script, &Script::message, [&] (ScriptInstance *, QJsonObject object, QVariant) {
+        lastSeq = object["payload"].toInt();
+    });
+
+    QList<double> samples;
+    for (int seq = 0; seq != iterations; seq++) {
+        QElapsedTimer timer;
+        timer.start();
+        instance->post(QJsonObject {
+            { "type", "ping" },
+            { "seq", seq },
+        });
+        if (!waitUntil([&] () { return lastSeq == seq; })) {
+            report->fail("Timed out waiting for a reply");
+            break;
+        }
+        samples.append(timer.nsecsElapsed() / 1e3);
+    }
+
+    report->addSamples("post_round_trip", samples, "us");
+
+    stopScript(script);
+    delete script;
+
+    return 0;
+}
@@ -0,0 +1,89 @@
+#include "harness.h"
+
+#include "device.h"
+#include "frida.h"
+#include "rpccall.h"
+#include "script.h"
+
+#include <QElapsedTimer>
+
+static const char *EchoAgent = R"(
+rpc.exports = {
+  echo(value) {
+    return value;
+  }
+};
+)";
+
+// RPC throughput and latency with a fixed number of calls kept outstanding.
+int runRpcBenchmark(const BenchmarkOptions &options, BenchmarkReport *report)
+{
+    int count = options.intValue("count", 5000);
+    report->setParameter("count", count);
+
+    TargetProcess target(options.target());
+    if (!target.start()) {
+        report->fail("Unable to start target process");
+        return 1;
+    }
+
+    auto device = Frida::instance()->localSystem();
+    auto script = createScript(EchoAgent);
+
+    QString errorMessage;
+    auto instance = injectScript(device, script, target.pid(), &errorMessage);
+    if (instance == nullptr) {
+        report->fail(errorMessage);
+        delete script;
+        return 1;
+    }
+
+    QElapsedTimer clock;
+    clock.start();
+
+    for (int outstanding : { 1, 16, 256 }) {
+        int issued = 0;
+        int settled = 0;
+        int failed = 0;
+        QList<double> samples;
+        samples.reserve(count);
+
+        std::function<void ()> issue = [&] () {
+            qint64 start = clock.nsecsElapsed();
+            auto call = instance->call("echo", QJsonArray { issued++ });
+            QObject::connect(call, &RpcCall::statusChanged, [&, call, start] (RpcCall::Status status) {
+                if (status == RpcCall::Status::Resolved)
+                    samples.append((clock.nsecsElapsed() - start) / 1e3);
+                else
+                    failed++;
+                settled++;
+                call->deleteLater();
+                if (issued != count)
+                    issue();
+            });
+        };
+
+        qint64 start = clock.nsecsElapsed();
+        for (int i = 0; i != outstanding && issued != count; i++)
+            issue();
+        if (!waitUntil([&] () { return settled == count; }, 120000)) {
+            report->fail(QString("Timed out with %1 calls outstanding").arg(outstanding));
+            break;
+        }
+        double seconds = (clock.nsecsElapsed() - start) / 1e9;
+
+        if (failed != 0) {
+            report->fail(QString("%1 calls failed").arg(failed));
+            break;
+        }
+
+        auto key = QString("outstanding_%1").arg(outstanding);
+        report->addMetric(key + "_calls_per_second", count / seconds, "calls/s");
+        report->addSamples(key + "_latency", samples, "us");
+    }
+
+    stopScript(script);
+    delete script;
+
+    return 0;
+}
@@ -0,0 +1,11 @@
+// Does nothing but stay alive, so the benchmarks have something to inject
+// into that is the same on every host.
+
+#include <chrono>
+#include <thread>
+
+int main()
+{
+    while (true)
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+}
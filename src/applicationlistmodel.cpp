@@ -5,7 +5,10 @@
 #include "device.h"
 #include "maincontext.h"
 #include "application.h"
+#include "stats.h"
+#include "tracing.h"
 
+#include <algorithm>
 #include <QMetaMethod>
 
 static const int ApplicationIdentifierRole = Qt::UserRole + 0;
@@ -160,7 +163,7 @@ void ApplicationListModel::finishHardRefresh(FridaDevice *handle, FridaScope sco
 
 void ApplicationListModel::enumerateApplications(FridaDevice *handle, FridaScope scope)
 {
-    QMetaObject::invokeMethod(this, "beginLoading", Qt::QueuedConnection);
+    invokeQueued(this, "beginLoading");
 
     if (m_pendingRequest != nullptr)
         m_pendingRequest->model = nullptr;
@@ -192,7 +195,7 @@ void ApplicationListModel::onEnumerateReady(FridaDevice *handle, GAsyncResult *r
 {
     m_pendingRequest = nullptr;
 
-    QMetaObject::invokeMethod(this, "endLoading", Qt::QueuedConnection);
+    invokeQueued(this, "endLoading");
 
     GError *error = nullptr;
     auto applicationHandles = frida_device_enumerate_applications_finish(handle, res, &error);
@@ -229,14 +232,14 @@ void ApplicationListModel::onEnumerateReady(FridaDevice *handle, GAsyncResult *r
 
         if (!added.isEmpty() || !removed.isEmpty()) {
             g_object_ref(handle);
-            QMetaObject::invokeMethod(this, "updateItems", Qt::QueuedConnection,
+            invokeQueued(this, "updateItems",
                 Q_ARG(void *, handle),
                 Q_ARG(QList<Application *>, added),
                 Q_ARG(QSet<QString>, removed));
         }
     } else {
         auto message = QString("Failed to enumerate applications: ").append(QString::fromUtf8(error->message));
-        QMetaObject::invokeMethod(this, "onError", Qt::QueuedConnection,
+        invokeQueued(this, "onError",
             Q_ARG(QString, message));
         g_clear_error(&error);
     }
@@ -247,8 +250,24 @@ int ApplicationListModel::score(Application *application)
     return (application->pid() != 0) ? 1 : 0;
 }
 
+bool ApplicationListModel::lessThan(Application *a, Application *b)
+{
+    auto scoreA = score(a);
+    auto scoreB = score(b);
+    if (scoreA != scoreB)
+        return scoreA > scoreB;
+
+    auto nameDifference = a->name().compare(b->name(), Qt::CaseInsensitive);
+    if (nameDifference != 0)
+        return nameDifference < 0;
+
+    return a->pid() < b->pid();
+}
+
 void ApplicationListModel::updateItems(void *handle, QList<Application *> added, QSet<QString> removed)
 {
+    FRIDAQML_TRACE_SCOPE("ApplicationListModel.updateItems");
+
     for (Application *application : std::as_const(added)) {
         application->setParent(this);
     }
@@ -262,42 +281,45 @@ void ApplicationListModel::updateItems(void *handle, QList<Application *> added,
 
     QModelIndex parentRow;
 
-    for (const QString& identifier : std::as_const(removed)) {
-        auto size = m_applications.size();
-        for (int i = 0; i != size; i++) {
-            auto application = m_applications[i];
-            if (application->identifier() == identifier) {
-                beginRemoveRows(parentRow, i, i);
-                m_applications.removeAt(i);
-                endRemoveRows();
-                delete application;
-                break;
-            }
+    // Remove in contiguous runs, walking backwards so indexes stay valid.
+    if (!removed.isEmpty()) {
+        for (int i = m_applications.size() - 1; i >= 0; i--) {
+            if (!removed.contains(m_applications[i]->identifier()))
+                continue;
+
+            int last = i;
+            while (i > 0 && removed.contains(m_applications[i - 1]->identifier()))
+                i--;
+
+            QList<Application *> doomed = m_applications.mid(i, last - i + 1);
+            beginRemoveRows(parentRow, i, last);
+            m_applications.remove(i, last - i + 1);
+            endRemoveRows();
+            qDeleteAll(doomed);
         }
     }
 
-    for (Application *application : std::as_const(added)) {
-        QString name = application->name();
-        auto applicationScore = score(application);
-        int index = -1;
-        auto size = m_applications.size();
-        for (int i = 0; i != size && index == -1; i++) {
-            auto curApplication = m_applications[i];
-            auto curApplicationScore = score(curApplication);
-            if (applicationScore > curApplicationScore) {
-                index = i;
-            } else if (applicationScore == curApplicationScore) {
-                auto nameDifference = name.compare(curApplication->name(), Qt::CaseInsensitive);
-                if (nameDifference < 0 || (nameDifference == 0 && application->pid() < curApplication->pid())) {
-                    index = i;
-                }
-            }
+    // Merge the sorted additions in, inserting runs that land between the
+    // same two existing rows with a single beginInsertRows().
+    std::sort(added.begin(), added.end(), lessThan);
+    int i = 0;
+    while (i != added.size()) {
+        int index = std::upper_bound(m_applications.begin(), m_applications.end(), added[i], lessThan) - m_applications.begin();
+
+        int j = i + 1;
+        if (index == m_applications.size()) {
+            j = added.size();
+        } else {
+            while (j != added.size() && lessThan(added[j], m_applications[index]))
+                j++;
         }
-        if (index == -1)
-            index = size;
-        beginInsertRows(parentRow, index, index);
-        m_applications.insert(index, application);
+
+        beginInsertRows(parentRow, index, index + (j - i) - 1);
+        m_applications.insert(index, j - i, nullptr);
+        std::copy(added.begin() + i, added.begin() + j, m_applications.begin() + index);
         endInsertRows();
+
+        i = j;
     }
 
     int newCount = m_applications.count();
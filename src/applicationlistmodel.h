@@ -60,6 +60,7 @@ private:
     void onEnumerateReady(FridaDevice *handle, GAsyncResult *res);
 
     static int score(Application *application);
+    static bool lessThan(Application *a, Application *b);
 
 private Q_SLOTS:
     void updateItems(void *handle, QList<Application *> added, QSet<QString> removed);
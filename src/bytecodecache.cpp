@@ -0,0 +1,121 @@
+#include "bytecodecache.h"
+
+#include <QCryptographicHash>
+#include <QDir>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QtEndian>
+
+static const char BytecodeCacheMagic[] = { 'F', 'Q', 'B', 'C' };
+static const quint32 BytecodeCacheVersion = 2;
+static const int BytecodeCacheKeySize = 32;
+static const int BytecodeCacheHeaderSize = sizeof(BytecodeCacheMagic) + 4 + BytecodeCacheKeySize + 8;
+
+BytecodeCache::BytecodeCache(QString directory, Script::Runtime runtime, QByteArray code,
+        std::shared_ptr<QFile> codeMapping) :
+    m_directory(directory),
+    m_runtime(runtime),
+    m_code(code),
+    m_codeMapping(codeMapping)
+{
+}
+
+QByteArray BytecodeCache::cacheKey(QString deviceId, QString fridaVersion)
+{
+    QMutexLocker locker(&m_mutex);
+
+    // Shared by every instance of the script, so the code is only hashed once.
+    if (m_codeHash.isEmpty())
+        m_codeHash = QCryptographicHash::hash(m_code, QCryptographicHash::Sha256);
+
+    QCryptographicHash hash(QCryptographicHash::Sha256);
+    hash.addData(m_codeHash);
+    hash.addData(QByteArray::number(static_cast<int>(m_runtime)));
+    hash.addData(deviceId.toUtf8());
+    hash.addData(QByteArray(1, '\0'));
+    hash.addData(fridaVersion.toUtf8());
+    return hash.result();
+}
+
+QByteArray BytecodeCache::load(QByteArray cacheKey)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto cached = m_bytecode.constFind(cacheKey);
+    if (cached != m_bytecode.cend())
+        return cached.value();
+
+    // Remembered even when missing, so later instances skip the disk.
+    auto &bytecode = m_bytecode[cacheKey];
+
+    QFile file(pathFor(cacheKey));
+    if (!file.open(QIODevice::ReadOnly))
+        return bytecode;
+
+    auto contents = file.readAll();
+    if (contents.size() <= BytecodeCacheHeaderSize)
+        return bytecode;
+
+    auto header = contents.constData();
+    if (memcmp(header, BytecodeCacheMagic, sizeof(BytecodeCacheMagic)) != 0)
+        return bytecode;
+    header += sizeof(BytecodeCacheMagic);
+
+    if (qFromLittleEndian<quint32>(header) != BytecodeCacheVersion)
+        return bytecode;
+    header += 4;
+
+    if (QByteArray::fromRawData(header, BytecodeCacheKeySize) != cacheKey)
+        return bytecode;
+    header += BytecodeCacheKeySize;
+
+    auto contentsBytecode = contents.mid(BytecodeCacheHeaderSize);
+    if (qFromLittleEndian<quint64>(header) != static_cast<quint64>(contentsBytecode.size()) ||
+            !contentsBytecode.startsWith(QUICKJS_BYTECODE_MAGIC))
+        return bytecode;
+
+    bytecode = contentsBytecode;
+    return bytecode;
+}
+
+void BytecodeCache::store(QByteArray cacheKey, QByteArray bytecode)
+{
+    QMutexLocker locker(&m_mutex);
+
+    auto &cached = m_bytecode[cacheKey];
+    if (!cached.isEmpty())
+        return;
+    cached = bytecode;
+
+    if (!QDir().mkpath(m_directory))
+        return;
+
+    QSaveFile file(pathFor(cacheKey));
+    if (!file.open(QIODevice::WriteOnly))
+        return;
+
+    char version[4];
+    qToLittleEndian<quint32>(BytecodeCacheVersion, version);
+    char size[8];
+    qToLittleEndian<quint64>(bytecode.size(), size);
+
+    file.write(BytecodeCacheMagic, sizeof(BytecodeCacheMagic));
+    file.write(version, sizeof(version));
+    file.write(cacheKey);
+    file.write(size, sizeof(size));
+    file.write(bytecode);
+    file.commit();
+}
+
+void BytecodeCache::discard(QByteArray cacheKey)
+{
+    QMutexLocker locker(&m_mutex);
+
+    m_bytecode[cacheKey] = QByteArray();
+    QFile::remove(pathFor(cacheKey));
+}
+
+QString BytecodeCache::pathFor(QByteArray cacheKey) const
+{
+    return QDir(m_directory).filePath(QString::fromLatin1(cacheKey.toHex()).append(".qjsbc"));
+}
@@ -0,0 +1,40 @@
+#ifndef FRIDAQML_BYTECODECACHE_H
+#define FRIDAQML_BYTECODECACHE_H
+
+#include "script.h"
+
+#include <memory>
+#include <QByteArray>
+#include <QFile>
+#include <QHash>
+#include <QMutex>
+#include <QString>
+
+// Compiled QuickJS bytecode for one revision of a script's code, kept on
+// disk. Created on the GUI thread, which is cheap; hashing the code and
+// touching the cache files happens on first use, from the thread pool.
+class BytecodeCache
+{
+public:
+    explicit BytecodeCache(QString directory, Script::Runtime runtime, QByteArray code,
+        std::shared_ptr<QFile> codeMapping);
+
+    QByteArray cacheKey(QString deviceId, QString fridaVersion);
+    QByteArray load(QByteArray cacheKey);
+    void store(QByteArray cacheKey, QByteArray bytecode);
+    void discard(QByteArray cacheKey);
+
+private:
+    QString pathFor(QByteArray cacheKey) const;
+
+    QString m_directory;
+    Script::Runtime m_runtime;
+    QByteArray m_code;
+    std::shared_ptr<QFile> m_codeMapping;
+
+    QMutex m_mutex;
+    QByteArray m_codeHash;
+    QHash<QByteArray, QByteArray> m_bytecode;
+};
+
+#endif
@@ -0,0 +1,150 @@
+#ifndef FRIDAQML_CAPPEDLOG_H
+#define FRIDAQML_CAPPEDLOG_H
+
+#include "stats.h"
+
+#include <QList>
+#include <QModelIndex>
+#include <QMutex>
+#include <QMutexLocker>
+#include <utility>
+
+// Entries recorded off the GUI thread until their owner takes them. Only the
+// newest `capacity` are kept if the GUI thread falls behind, and the owner's
+// `drain` slot is invoked when the first one comes in.
+template <typename T>
+class PendingEntries
+{
+public:
+    PendingEntries(QObject *owner, const char *drain, int capacity) :
+        m_owner(owner),
+        m_drain(drain),
+        m_capacity(capacity)
+    {
+    }
+
+    void append(T entry)
+    {
+        QMutexLocker locker(&m_mutex);
+
+        if (m_owner == nullptr)
+            return;
+
+        bool wasEmpty = m_entries.isEmpty();
+
+        if (m_entries.size() == m_capacity)
+            m_entries.removeFirst();
+        m_entries.append(std::move(entry));
+
+        if (wasEmpty)
+            invokeQueued(m_owner, m_drain);
+    }
+
+    void setCapacity(int capacity)
+    {
+        QMutexLocker locker(&m_mutex);
+        m_capacity = capacity;
+        if (m_entries.size() > capacity)
+            m_entries.remove(0, m_entries.size() - capacity);
+    }
+
+    QList<T> take()
+    {
+        QMutexLocker locker(&m_mutex);
+        QList<T> entries;
+        entries.swap(m_entries);
+        return entries;
+    }
+
+    void detach()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_owner = nullptr;
+        m_entries.clear();
+    }
+
+private:
+    QMutex m_mutex;
+    QObject *m_owner;
+    const char *m_drain;
+    int m_capacity;
+    QList<T> m_entries;
+};
+
+// The rows of a list model that keeps only its newest entries. They live in
+// a ring, so dropping the oldest doesn't move the rest, and each batch is one
+// insert plus at most one remove for the model's views. The model must be a
+// friend, and have a countChanged(int) signal.
+template <typename Model, typename T>
+class CappedRows
+{
+public:
+    explicit CappedRows(Model *model) :
+        m_model(model),
+        m_head(0),
+        m_size(0)
+    {
+    }
+
+    int size() const { return m_size; }
+    const T &at(int index) const { return m_items[(m_head + index) % m_items.size()]; }
+
+    void append(QList<T> entries, int capacity)
+    {
+        if (entries.isEmpty())
+            return;
+
+        if (entries.size() > capacity)
+            entries.remove(0, entries.size() - capacity);
+
+        trim(capacity - entries.size());
+        reserve(capacity);
+
+        m_model->beginInsertRows(QModelIndex(), m_size, m_size + entries.size() - 1);
+        for (T &entry : entries)
+            m_items[(m_head + m_size++) % m_items.size()] = std::move(entry);
+        m_model->endInsertRows();
+        Q_EMIT m_model->countChanged(m_size);
+    }
+
+    void trim(int capacity)
+    {
+        auto excess = m_size - capacity;
+        if (excess <= 0)
+            return;
+
+        m_model->beginRemoveRows(QModelIndex(), 0, excess - 1);
+        if (excess == m_size) {
+            m_items.clear();
+            m_head = 0;
+        } else {
+            for (int i = 0; i != excess; i++)
+                m_items[(m_head + i) % m_items.size()] = T();
+            m_head = (m_head + excess) % m_items.size();
+        }
+        m_size -= excess;
+        m_model->endRemoveRows();
+        Q_EMIT m_model->countChanged(m_size);
+    }
+
+private:
+    // Laid out afresh only when the capacity changes, which is rare.
+    void reserve(int capacity)
+    {
+        if (m_items.size() == capacity)
+            return;
+
+        QList<T> items(capacity);
+        for (int i = 0; i != m_size; i++)
+            items[i] = std::move(m_items[(m_head + i) % m_items.size()]);
+        m_items.swap(items);
+        m_head = 0;
+    }
+
+    Model *m_model;
+    QList<T> m_items;
+    int m_head;
+    int m_size;
+};
+
+#endif
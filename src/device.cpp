@@ -2,19 +2,46 @@
 
 #include "device.h"
 
+#include "bytecodecache.h"
+#include "logsink.h"
 #include "maincontext.h"
+#include "messagedispatcher.h"
 #include "script.h"
 #include "spawnoptions.h"
+#include "stats.h"
+#include "tracing.h"
 #include "variant.h"
 
 #include <memory>
-#include <QDebug>
+#include <QCborValue>
 #include <QJsonDocument>
 #include <QPointer>
+#include <QQueue>
+#include <QThreadPool>
 
-#define QUICKJS_BYTECODE_MAGIC 0x02
+struct ScriptCodeBuffer
+{
+    QByteArray code;
+    std::shared_ptr<QFile> mapping;
+};
 
-static void deleteByteArray(gpointer data);
+struct DeviceShutdown
+{
+    Device *device;
+    GCancellable *cancellable;
+    GSource *deadline;
+    QQueue<FridaSession *> sessions;
+    int maxPending;
+    int pending;
+    int completed;
+    int total;
+};
+
+static const guint SessionResumeInitialDelay = 250;
+static const guint SessionResumeMaxDelay = 8000;
+
+static void deleteScriptCodeBuffer(gpointer data);
+static void reportTiming(ScriptInstance *wrapper, const char *stage, gint64 startTime);
 
 Device::Device(FridaDevice *handle, QObject *parent) :
     QObject(parent),
@@ -22,7 +49,15 @@ Device::Device(FridaDevice *handle, QObject *parent) :
     m_id(frida_device_get_id(handle)),
     m_name(frida_device_get_name(handle)),
     m_type(static_cast<Device::Type>(frida_device_get_dtype(handle))),
+    m_persistTimeout(0),
+    m_sessionPersistTimeout(0),
+    m_injected(false),
+    m_serverVersionKnown(false),
     m_gcTimer(nullptr),
+    m_stopBatchDepth(0),
+    m_shuttingDown(false),
+    m_shutDown(false),
+    m_shutdown(nullptr),
     m_mainContext(new MainContext(frida_get_main_context()))
 {
     auto serializedIcon = Frida::parseVariant(frida_device_get_icon(handle)).toMap();
@@ -35,6 +70,11 @@ Device::Device(FridaDevice *handle, QObject *parent) :
 
 void Device::dispose()
 {
+    if (m_shutdown != nullptr) {
+        abandonShutdown(m_shutdown);
+        m_shutdown = nullptr;
+    }
+
     if (m_gcTimer != nullptr) {
         g_source_destroy(m_gcTimer);
         m_gcTimer = nullptr;
@@ -45,6 +85,9 @@ void Device::dispose()
         delete it.value();
         ++it;
     }
+    m_pendingLoads.clear();
+    m_spawning.clear();
+    m_serverVersionRequests.clear();
 
     g_object_set_data(G_OBJECT(m_handle), "qdevice", nullptr);
     g_object_unref(m_handle);
@@ -57,6 +100,31 @@ Device::~Device()
     m_mainContext->perform([this] () { dispose(); });
 }
 
+void Device::setPersistTimeout(int persistTimeout)
+{
+    if (persistTimeout == m_persistTimeout || persistTimeout < 0)
+        return;
+
+    m_persistTimeout = persistTimeout;
+    m_mainContext->schedule([=] () { m_sessionPersistTimeout = persistTimeout; });
+    Q_EMIT persistTimeoutChanged(m_persistTimeout);
+}
+
+void Device::setDedicatedThread(bool dedicatedThread)
+{
+    if (dedicatedThread == hasDedicatedThread())
+        return;
+
+    if (m_injected) {
+        qWarning("Device.dedicatedThread must be set before the first inject()");
+        return;
+    }
+
+    m_decodeContext.reset(dedicatedThread ? MainContext::createWorker("frida-qml-device") : nullptr);
+
+    Q_EMIT dedicatedThreadChanged(dedicatedThread);
+}
+
 ScriptInstance *Device::inject(Script *script, QString program, SpawnOptions *options)
 {
     ScriptInstance *instance = createScriptInstance(script, -1);
@@ -67,11 +135,19 @@ ScriptInstance *Device::inject(Script *script, QString program, SpawnOptions *op
     if (options != nullptr) {
         optionsHandle = options->handle();
         g_object_ref(optionsHandle);
+        instance->m_autoResume = options->autoResume();
     } else {
         optionsHandle = nullptr;
     }
 
-    m_mainContext->schedule([=] () { performSpawn(program, optionsHandle, instance); });
+    // Hand over the script ahead of the spawn, so it is created as soon as
+    // the session is up instead of after a round-trip through this thread.
+    auto load = prepareLoad(instance);
+    m_mainContext->schedule([=] () {
+        if (load)
+            m_pendingLoads[instance] = load;
+        performSpawn(program, optionsHandle, instance);
+    });
 
     return instance;
 }
@@ -87,54 +163,106 @@ ScriptInstance *Device::inject(Script *script, int pid)
     return instance;
 }
 
+void Device::shutdown(int maxPending, int timeout)
+{
+    if (m_shuttingDown)
+        return;
+    m_shuttingDown = true;
+
+    m_mainContext->schedule([=] () { performShutdown(maxPending, timeout); });
+}
+
+void Device::enableChildGating(int pid)
+{
+    m_mainContext->schedule([=] () { performEnableChildGating(pid); });
+}
+
 ScriptInstance *Device::createScriptInstance(Script *script, int pid)
 {
+    if (m_shuttingDown) {
+        qWarning("Device.inject() called after shutdown()");
+        return nullptr;
+    }
+
     ScriptInstance *instance = (script != nullptr) ? script->bind(this, pid) : nullptr;
     if (instance == nullptr)
         return nullptr;
+    m_injected = true;
 
     QPointer<Device> device(this);
     auto onStatusChanged = std::make_shared<QMetaObject::Connection>();
     auto onResumeRequest = std::make_shared<QMetaObject::Connection>();
     auto onStopRequest = std::make_shared<QMetaObject::Connection>();
     auto onSend = std::make_shared<QMetaObject::Connection>();
+    auto onRpcCall = std::make_shared<QMetaObject::Connection>();
+    auto onAbandonRpcCall = std::make_shared<QMetaObject::Connection>();
     auto onEnableDebugger = std::make_shared<QMetaObject::Connection>();
     auto onDisableDebugger = std::make_shared<QMetaObject::Connection>();
+    auto onAttachLogSink = std::make_shared<QMetaObject::Connection>();
+    auto onAttachMessageTaps = std::make_shared<QMetaObject::Connection>();
+    auto onReload = std::make_shared<QMetaObject::Connection>();
     *onStatusChanged = connect(script, &Script::statusChanged, [=] () {
         tryPerformLoad(instance);
     });
     *onResumeRequest = connect(instance, &ScriptInstance::resumeProcessRequest, [=] () {
-        m_mainContext->schedule([=] () { performResume(instance); });
+        auto pid = instance->pid();
+        m_mainContext->schedule([=] () { performResume(instance, pid); });
     });
     *onStopRequest = connect(instance, &ScriptInstance::stopRequest, [=] () {
         QObject::disconnect(*onStatusChanged);
         QObject::disconnect(*onResumeRequest);
         QObject::disconnect(*onStopRequest);
         QObject::disconnect(*onSend);
+        QObject::disconnect(*onRpcCall);
+        QObject::disconnect(*onAbandonRpcCall);
         QObject::disconnect(*onEnableDebugger);
         QObject::disconnect(*onDisableDebugger);
+        QObject::disconnect(*onAttachLogSink);
+        QObject::disconnect(*onAttachMessageTaps);
+        QObject::disconnect(*onReload);
 
         script->unbind(instance);
 
-        if (!device.isNull()) {
-            device->m_mainContext->schedule([=] () { device->performStop(instance); });
-        }
+        if (!device.isNull())
+            device->requestStop(instance);
     });
     *onSend = connect(instance, &ScriptInstance::send, [=] (QJsonValue value) {
         m_mainContext->schedule([=] () { performPost(instance, value); });
     });
+    *onRpcCall = connect(instance, &ScriptInstance::rpcCallRequest, [=] (int id, QJsonValue request) {
+        m_mainContext->schedule([=] () { performRpcCall(instance, id, request); });
+    });
+    *onAbandonRpcCall = connect(instance, &ScriptInstance::abandonRpcCallRequest, [=] (int id) {
+        m_mainContext->schedule([=] () { performAbandonRpcCall(instance, id); });
+    });
     *onEnableDebugger = connect(instance, &ScriptInstance::enableDebuggerRequest, [=] (quint16 port) {
         m_mainContext->schedule([=] () { performEnableDebugger(instance, port); });
     });
     *onDisableDebugger = connect(instance, &ScriptInstance::disableDebuggerRequest, [=] () {
         m_mainContext->schedule([=] () { performDisableDebugger(instance); });
     });
+    *onAttachLogSink = connect(instance, &ScriptInstance::attachLogSinkRequest, [=] (LogSink *sink) {
+        auto buffer = (sink != nullptr) ? sink->buffer() : std::shared_ptr<LogBuffer>();
+        m_mainContext->schedule([=] () { performAttachLogSink(instance, buffer); });
+    });
+    *onAttachMessageTaps = connect(instance, &ScriptInstance::attachMessageTapsRequest, [=] () {
+        auto taps = instance->messageTaps();
+        m_mainContext->schedule([=] () { performAttachMessageTaps(instance, taps); });
+    });
+    *onReload = connect(instance, &ScriptInstance::reloadRequest, [=] () {
+        tryPerformReload(instance);
+    });
+
+    instance->updateLogSink();
 
     return instance;
 }
 
 void Device::performSpawn(QString program, FridaSpawnOptions *options, ScriptInstance *wrapper)
 {
+    m_spawning.insert(wrapper);
+    m_stageStartTimes[wrapper] = g_get_monotonic_time();
+
     std::string programStr = program.toStdString();
     frida_device_spawn(handle(), programStr.c_str(), options, nullptr, onSpawnReadyWrapper, wrapper);
     g_object_unref(options);
@@ -153,24 +281,37 @@ void Device::onSpawnReady(GAsyncResult *res, ScriptInstance *wrapper)
     GError *error = nullptr;
     guint pid = frida_device_spawn_finish(handle(), res, &error);
 
+    // Stopped while spawning, so the wrapper may already be gone. Let the
+    // process run rather than leave it suspended.
+    if (!m_spawning.remove(wrapper)) {
+        if (error == nullptr)
+            frida_device_resume(handle(), pid, nullptr, nullptr, nullptr);
+        g_clear_error(&error);
+        return;
+    }
+
+    reportTiming(wrapper, "spawn", m_stageStartTimes.take(wrapper));
+
     if (error == nullptr) {
-        QMetaObject::invokeMethod(wrapper, "onSpawnComplete", Qt::QueuedConnection,
+        invokeQueued(wrapper, "onSpawnComplete",
             Q_ARG(int, pid));
 
         performInject(pid, wrapper);
     } else {
-        QMetaObject::invokeMethod(wrapper, "onError", Qt::QueuedConnection,
+        invokeQueued(wrapper, "onError",
             Q_ARG(QString, QString::fromUtf8(error->message)));
-        QMetaObject::invokeMethod(wrapper, "onStatus", Qt::QueuedConnection,
+        invokeQueued(wrapper, "onStatus",
             Q_ARG(ScriptInstance::Status, ScriptInstance::Status::Error));
 
         g_clear_error(&error);
     }
 }
 
-void Device::performResume(ScriptInstance *wrapper)
+void Device::performResume(ScriptInstance *wrapper, int pid)
 {
-    frida_device_resume(handle(), wrapper->pid(), nullptr, onResumeReadyWrapper, wrapper);
+    m_stageStartTimes[wrapper] = g_get_monotonic_time();
+
+    frida_device_resume(handle(), pid, nullptr, onResumeReadyWrapper, wrapper);
 }
 
 void Device::onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
@@ -186,23 +327,83 @@ void Device::onResumeReady(GAsyncResult *res, ScriptInstance *wrapper)
     GError *error = nullptr;
     frida_device_resume_finish(handle(), res, &error);
 
+    reportTiming(wrapper, "resume", m_stageStartTimes.take(wrapper));
+
     if (error == nullptr) {
-        QMetaObject::invokeMethod(wrapper, "onResumeComplete", Qt::QueuedConnection);
+        invokeQueued(wrapper, "onResumeComplete");
     } else {
-        QMetaObject::invokeMethod(wrapper, "onError", Qt::QueuedConnection,
+        invokeQueued(wrapper, "onError",
             Q_ARG(QString, QString::fromUtf8(error->message)));
-        QMetaObject::invokeMethod(wrapper, "onStatus", Qt::QueuedConnection,
+        invokeQueued(wrapper, "onStatus",
             Q_ARG(ScriptInstance::Status, ScriptInstance::Status::Error));
 
         g_clear_error(&error);
     }
 }
 
+void Device::queryServerVersion(std::function<void (QString)> callback)
+{
+    if (m_type == Type::Local) {
+        callback(QString::fromUtf8(frida_version_string()));
+        return;
+    }
+
+    if (m_serverVersionKnown) {
+        callback(m_serverVersion);
+        return;
+    }
+
+    m_serverVersionRequests.append(callback);
+    if (m_serverVersionRequests.size() == 1)
+        frida_device_query_system_parameters(handle(), nullptr, onQuerySystemParametersReadyWrapper, nullptr);
+}
+
+void Device::onQuerySystemParametersReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(data);
+
+    Device *device = static_cast<Device *>(g_object_get_data(obj, "qdevice"));
+    if (device != nullptr) {
+        device->onQuerySystemParametersReady(res);
+    }
+}
+
+void Device::onQuerySystemParametersReady(GAsyncResult *res)
+{
+    GError *error = nullptr;
+    GHashTable *parameters = frida_device_query_system_parameters_finish(handle(), res, &error);
+
+    // Asked again next time on failure; meanwhile the cache is keyed by the
+    // device id alone, same as for a server that doesn't report its version.
+    if (error == nullptr) {
+        auto fridaParameters = Frida::parseParametersDict(parameters).value("frida").toMap();
+        m_serverVersion = fridaParameters.value("version").toString();
+        m_serverVersionKnown = true;
+        g_hash_table_unref(parameters);
+    } else {
+        g_clear_error(&error);
+    }
+
+    auto requests = m_serverVersionRequests;
+    m_serverVersionRequests.clear();
+    for (const auto &callback : requests)
+        callback(m_serverVersion);
+}
+
+void Device::performEnableChildGating(int pid)
+{
+    auto session = m_sessions.value(pid);
+    if (session != nullptr)
+        session->enableChildGating();
+}
+
 void Device::performInject(int pid, ScriptInstance *wrapper)
 {
+    FRIDAQML_TRACE_SCOPE("Device.performInject");
+
     auto session = m_sessions[pid];
     if (session == nullptr) {
-        session = new SessionEntry(this, pid);
+        session = new SessionEntry(this, pid, m_sessionPersistTimeout);
         m_sessions[pid] = session;
         connect(session, &SessionEntry::detached, [=] () {
             for (ScriptEntry *script : session->scripts())
@@ -220,40 +421,130 @@ void Device::performInject(int pid, ScriptInstance *wrapper)
         m_mainContext->schedule([=] () { delete script; });
     });
 
-    QMetaObject::invokeMethod(this, "tryPerformLoad", Qt::QueuedConnection,
-        Q_ARG(ScriptInstance *, wrapper));
+    auto pendingLoad = m_pendingLoads.take(wrapper);
+    if (pendingLoad) {
+        pendingLoad();
+    } else {
+        invokeQueued(this, "tryPerformLoad",
+            Q_ARG(ScriptInstance *, wrapper));
+    }
 }
 
 void Device::tryPerformLoad(ScriptInstance *wrapper)
+{
+    FRIDAQML_TRACE_SCOPE("Device.tryPerformLoad");
+
+    auto load = prepareLoad(wrapper);
+    if (!load)
+        return;
+
+    // Only a spawn hands its load over ahead of the session; anything else
+    // for a wrapper that is not bound is for one that has been stopped, and
+    // parking it would leave it keyed by a pointer that may be reused.
+    m_mainContext->schedule([=] () {
+        if (m_scripts.contains(wrapper))
+            load();
+    });
+}
+
+std::function<void ()> Device::prepareLoad(ScriptInstance *wrapper)
 {
     Script *script = reinterpret_cast<Script *>(wrapper->parent());
     if (script->status() != Script::Status::Loaded)
-        return;
+        return nullptr;
 
     auto name = script->name();
     auto runtime = script->runtime();
-    auto code = script->code();
-    m_mainContext->schedule([=] () { performLoad(wrapper, name, runtime, code); });
+    auto code = script->m_code;
+    auto codeMapping = script->m_codeMapping;
+    auto bytecodeCache = script->m_bytecodeCache;
+    auto offloadMessages = script->offloadMessages();
+    auto encoding = script->encoding();
+    auto logSink = wrapper->m_effectiveLogSink;
+    auto logBuffer = (logSink != nullptr) ? logSink->buffer() : std::shared_ptr<LogBuffer>();
+    auto messageTaps = wrapper->messageTaps();
+    return [=] () {
+        performAttachLogSink(wrapper, logBuffer);
+        performAttachMessageTaps(wrapper, messageTaps);
+        performLoad(wrapper, name, runtime, code, codeMapping, bytecodeCache, offloadMessages, encoding);
+    };
 }
 
-void Device::performLoad(ScriptInstance *wrapper, QString name, Script::Runtime runtime, QByteArray code)
+void Device::performLoad(ScriptInstance *wrapper, QString name, Script::Runtime runtime, QByteArray code,
+    std::shared_ptr<QFile> codeMapping, std::shared_ptr<BytecodeCache> bytecodeCache, bool offloadMessages,
+    Script::Encoding encoding)
 {
     auto script = m_scripts[wrapper];
     if (script == nullptr)
         return;
-    script->load(name, runtime, code);
+    script->load(name, runtime, code, codeMapping, bytecodeCache, offloadMessages, encoding);
+}
+
+void Device::tryPerformReload(ScriptInstance *wrapper)
+{
+    Script *script = reinterpret_cast<Script *>(wrapper->parent());
+
+    auto code = script->m_code;
+    auto codeMapping = script->m_codeMapping;
+    auto bytecodeCache = script->m_bytecodeCache;
+    m_mainContext->schedule([=] () { performReload(wrapper, code, codeMapping, bytecodeCache); });
 }
 
-void Device::performStop(ScriptInstance *wrapper)
+void Device::performReload(ScriptInstance *wrapper, QByteArray code, std::shared_ptr<QFile> codeMapping,
+    std::shared_ptr<BytecodeCache> bytecodeCache)
 {
     auto script = m_scripts[wrapper];
     if (script == nullptr)
         return;
-    m_scripts.remove(wrapper);
+    script->reload(code, codeMapping, bytecodeCache);
+}
 
-    script->session()->remove(script);
+void Device::beginStopBatch()
+{
+    m_stopBatchDepth++;
+}
 
-    scheduleGarbageCollect();
+void Device::endStopBatch()
+{
+    if (--m_stopBatchDepth == 0)
+        flushStops();
+}
+
+void Device::requestStop(ScriptInstance *wrapper)
+{
+    m_pendingStops.append(wrapper);
+    if (m_stopBatchDepth == 0)
+        flushStops();
+}
+
+void Device::flushStops()
+{
+    if (m_pendingStops.isEmpty())
+        return;
+
+    auto wrappers = m_pendingStops;
+    m_pendingStops.clear();
+    m_mainContext->schedule([=] () { performStop(wrappers); });
+}
+
+void Device::performStop(QList<ScriptInstance *> wrappers)
+{
+    bool removed = false;
+    for (auto wrapper : std::as_const(wrappers)) {
+        m_pendingLoads.remove(wrapper);
+        m_spawning.remove(wrapper);
+        m_stageStartTimes.remove(wrapper);
+
+        auto script = m_scripts.take(wrapper);
+        if (script == nullptr)
+            continue;
+
+        script->session()->remove(script);
+        removed = true;
+    }
+
+    if (removed)
+        scheduleGarbageCollect();
 }
 
 void Device::performPost(ScriptInstance *wrapper, QJsonValue value)
@@ -264,6 +555,22 @@ void Device::performPost(ScriptInstance *wrapper, QJsonValue value)
     script->post(value);
 }
 
+void Device::performRpcCall(ScriptInstance *wrapper, int id, QJsonValue request)
+{
+    auto script = m_scripts[wrapper];
+    if (script == nullptr)
+        return;
+    script->call(id, request);
+}
+
+void Device::performAbandonRpcCall(ScriptInstance *wrapper, int id)
+{
+    auto script = m_scripts[wrapper];
+    if (script == nullptr)
+        return;
+    script->abandonCall(id);
+}
+
 void Device::performEnableDebugger(ScriptInstance *wrapper, quint16 port)
 {
     auto script = m_scripts[wrapper];
@@ -280,6 +587,22 @@ void Device::performDisableDebugger(ScriptInstance *wrapper)
     script->disableDebugger();
 }
 
+void Device::performAttachLogSink(ScriptInstance *wrapper, std::shared_ptr<LogBuffer> buffer)
+{
+    auto script = m_scripts[wrapper];
+    if (script == nullptr)
+        return;
+    script->attachLogSink(buffer);
+}
+
+void Device::performAttachMessageTaps(ScriptInstance *wrapper, MessageTapList taps)
+{
+    auto script = m_scripts[wrapper];
+    if (script == nullptr)
+        return;
+    script->attachMessageTaps(taps);
+}
+
 void Device::scheduleGarbageCollect()
 {
     if (m_gcTimer != nullptr) {
@@ -320,21 +643,169 @@ void Device::onGarbageCollectTimeout()
     m_sessions = newSessions;
 }
 
-SessionEntry::SessionEntry(Device *device, int pid, QObject *parent) :
+void Device::performShutdown(int maxPending, int timeout)
+{
+    if (m_gcTimer != nullptr) {
+        g_source_destroy(m_gcTimer);
+        m_gcTimer = nullptr;
+    }
+
+    // Late spawn, resume and attach results are dropped from here on, just
+    // like they are once the device is disposed.
+    g_object_set_data(G_OBJECT(m_handle), "qdevice", nullptr);
+    m_pendingLoads.clear();
+    m_spawning.clear();
+    m_stageStartTimes.clear();
+    m_serverVersionRequests.clear();
+    m_scripts.clear();
+
+    auto shutdown = new DeviceShutdown { this, g_cancellable_new(), nullptr, {}, qMax(maxPending, 1), 0, 0, 0 };
+    for (SessionEntry *session : std::as_const(m_sessions)) {
+        for (ScriptEntry *script : session->scripts())
+            script->notifySessionError("Device shut down");
+
+        auto handle = session->takeHandle();
+        if (handle != nullptr)
+            shutdown->sessions.enqueue(handle);
+
+        // Fires off the unloads of the session's scripts, which the agent
+        // handles ahead of the detach that we queue up behind them.
+        delete session;
+    }
+    m_sessions.clear();
+    shutdown->total = shutdown->sessions.size();
+    m_shutdown = shutdown;
+
+    invokeQueued(this, "shutdownProgress",
+        Q_ARG(int, 0),
+        Q_ARG(int, shutdown->total));
+
+    if (timeout > 0) {
+        auto deadline = g_timeout_source_new(timeout);
+        g_source_set_callback(deadline, onShutdownDeadlineWrapper, shutdown, nullptr);
+        g_source_attach(deadline, m_mainContext->handle());
+        g_source_unref(deadline);
+        shutdown->deadline = deadline;
+    }
+
+    detachNext(shutdown);
+}
+
+void Device::detachNext(DeviceShutdown *shutdown)
+{
+    while (shutdown->pending < shutdown->maxPending && !shutdown->sessions.isEmpty()) {
+        shutdown->pending++;
+        frida_session_detach(shutdown->sessions.dequeue(), shutdown->cancellable, onDetachReadyWrapper, shutdown);
+    }
+
+    if (shutdown->pending == 0)
+        finishShutdown(shutdown, 0);
+}
+
+void Device::onDetachReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    auto shutdown = static_cast<DeviceShutdown *>(data);
+
+    frida_session_detach_finish(FRIDA_SESSION(obj), res, nullptr);
+    g_object_unref(obj);
+    shutdown->pending--;
+
+    if (shutdown->device != nullptr)
+        shutdown->device->onDetachReady(shutdown);
+    else if (shutdown->pending == 0)
+        releaseShutdown(shutdown);
+}
+
+void Device::onDetachReady(DeviceShutdown *shutdown)
+{
+    shutdown->completed++;
+    invokeQueued(this, "shutdownProgress",
+        Q_ARG(int, shutdown->completed),
+        Q_ARG(int, shutdown->total));
+
+    detachNext(shutdown);
+}
+
+gboolean Device::onShutdownDeadlineWrapper(gpointer data)
+{
+    auto shutdown = static_cast<DeviceShutdown *>(data);
+
+    shutdown->deadline = nullptr;
+    shutdown->device->finishShutdown(shutdown, static_cast<int>(shutdown->sessions.size()) + shutdown->pending);
+
+    return FALSE;
+}
+
+void Device::finishShutdown(DeviceShutdown *shutdown, int abandoned)
+{
+    m_shutdown = nullptr;
+    abandonShutdown(shutdown);
+
+    invokeQueued(this, "onShutdownFinished",
+        Q_ARG(int, abandoned));
+}
+
+void Device::abandonShutdown(DeviceShutdown *shutdown)
+{
+    shutdown->device = nullptr;
+
+    if (shutdown->deadline != nullptr) {
+        g_source_destroy(shutdown->deadline);
+        shutdown->deadline = nullptr;
+    }
+
+    for (FridaSession *handle : std::as_const(shutdown->sessions))
+        g_object_unref(handle);
+    shutdown->sessions.clear();
+
+    // Detaches still in flight hold on to the shutdown until they complete.
+    g_cancellable_cancel(shutdown->cancellable);
+    if (shutdown->pending == 0)
+        releaseShutdown(shutdown);
+}
+
+void Device::releaseShutdown(DeviceShutdown *shutdown)
+{
+    g_object_unref(shutdown->cancellable);
+    delete shutdown;
+}
+
+void Device::onShutdownFinished(int abandoned)
+{
+    m_shutDown = true;
+    Q_EMIT shutdownFinished(abandoned);
+}
+
+SessionEntry::SessionEntry(Device *device, int pid, int persistTimeout, QObject *parent) :
     QObject(parent),
     m_device(device),
     m_pid(pid),
-    m_handle(nullptr)
+    m_persistTimeout(persistTimeout),
+    m_handle(nullptr),
+    m_detachedHandler(0),
+    m_childGating(false),
+    m_interrupted(false),
+    m_resumeDeadline(0),
+    m_resumeDelay(SessionResumeInitialDelay),
+    m_resumeTimer(nullptr)
 {
-    frida_device_attach(device->handle(), pid, nullptr, nullptr, onAttachReadyWrapper, this);
+    auto options = frida_session_options_new();
+    if (persistTimeout > 0)
+        frida_session_options_set_persist_timeout(options, persistTimeout);
+
+    frida_device_attach(device->handle(), pid, options, nullptr, onAttachReadyWrapper, this);
+
+    g_object_unref(options);
 }
 
 SessionEntry::~SessionEntry()
 {
+    cancelResume();
+
     if (m_handle != nullptr) {
         frida_session_detach(m_handle, nullptr, nullptr, nullptr);
 
-        g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onDetachedWrapper), this);
+        g_signal_handler_disconnect(m_handle, m_detachedHandler);
 
         g_object_set_data(G_OBJECT(m_handle), "qsession", nullptr);
         g_object_unref(m_handle);
@@ -355,6 +826,33 @@ void SessionEntry::remove(ScriptEntry *script)
     m_scripts.removeOne(script);
 }
 
+FridaSession *SessionEntry::takeHandle()
+{
+    auto handle = m_handle;
+    if (handle == nullptr)
+        return nullptr;
+
+    // Whoever takes the handle, e.g. Device.shutdown(), decides its fate, so
+    // we stop trying to resume it.
+    cancelResume();
+
+    g_signal_handler_disconnect(handle, m_detachedHandler);
+    g_object_set_data(G_OBJECT(handle), "qsession", nullptr);
+    m_handle = nullptr;
+
+    return handle;
+}
+
+void SessionEntry::enableChildGating()
+{
+    if (m_childGating)
+        return;
+    m_childGating = true;
+
+    if (m_handle != nullptr)
+        frida_session_enable_child_gating(m_handle, nullptr, nullptr, nullptr);
+}
+
 void SessionEntry::onAttachReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
 {
     if (g_object_get_data(obj, "qdevice") != nullptr) {
@@ -364,12 +862,17 @@ void SessionEntry::onAttachReadyWrapper(GObject *obj, GAsyncResult *res, gpointe
 
 void SessionEntry::onAttachReady(GAsyncResult *res)
 {
+    FRIDAQML_TRACE_SCOPE("SessionEntry.onAttachReady");
+
     GError *error = nullptr;
     m_handle = frida_device_attach_finish(m_device->handle(), res, &error);
     if (error == nullptr) {
         g_object_set_data(G_OBJECT(m_handle), "qsession", this);
 
-        g_signal_connect_swapped(m_handle, "detached", G_CALLBACK(onDetachedWrapper), this);
+        m_detachedHandler = g_signal_connect_swapped(m_handle, "detached", G_CALLBACK(onDetachedWrapper), this);
+
+        if (m_childGating)
+            frida_session_enable_child_gating(m_handle, nullptr, nullptr, nullptr);
 
         for (ScriptEntry *script : std::as_const(m_scripts)) {
             script->updateSessionHandle(m_handle);
@@ -382,7 +885,7 @@ void SessionEntry::onAttachReady(GAsyncResult *res)
     }
 }
 
-void SessionEntry::onDetachedWrapper(SessionEntry *self, int reason, FridaCrash * crash)
+void SessionEntry::onDetachedWrapper(SessionEntry *self, int reason, FridaCrash *crash)
 {
     Q_UNUSED(crash);
 
@@ -391,6 +894,30 @@ void SessionEntry::onDetachedWrapper(SessionEntry *self, int reason, FridaCrash
 
 void SessionEntry::onDetached(DetachReason reason)
 {
+    FRIDAQML_TRACE_SCOPE("SessionEntry.onDetached");
+
+    // Only a lost connection is transient: the process is still there, and
+    // with a persist timeout so is the session on its end. Every other
+    // reason means the session is gone for good.
+    if (reason == DetachReason::ConnectionTerminated && m_persistTimeout > 0) {
+        if (m_interrupted)
+            return;
+
+        // The session survives on the other end for persistTimeout seconds,
+        // so keep our scripts and try to pick it back up.
+        m_interrupted = true;
+        m_resumeDeadline = g_get_monotonic_time() + static_cast<gint64>(m_persistTimeout) * G_USEC_PER_SEC;
+        m_resumeDelay = SessionResumeInitialDelay;
+
+        for (ScriptEntry *script : std::as_const(m_scripts))
+            script->notifySessionInterrupted();
+
+        scheduleResume();
+        return;
+    }
+
+    cancelResume();
+
     const char *message;
     switch (reason) {
     case DetachReason::ApplicationRequested:
@@ -418,32 +945,128 @@ void SessionEntry::onDetached(DetachReason reason)
     Q_EMIT detached(reason);
 }
 
+void SessionEntry::scheduleResume()
+{
+    // Back off so a server that is down for a while isn't hammered, without
+    // overshooting the point where the session is gone anyway.
+    auto remaining = (m_resumeDeadline - g_get_monotonic_time()) / 1000;
+    auto delay = static_cast<guint>(qBound<gint64>(0, remaining, m_resumeDelay));
+    m_resumeDelay = qMin(m_resumeDelay * 2, SessionResumeMaxDelay);
+
+    auto timer = g_timeout_source_new(delay);
+    g_source_set_callback(timer, onResumeTimeoutWrapper, this, nullptr);
+    g_source_attach(timer, m_device->mainContext()->handle());
+    g_source_unref(timer);
+    m_resumeTimer = timer;
+}
+
+void SessionEntry::cancelResume()
+{
+    if (m_resumeTimer != nullptr) {
+        g_source_destroy(m_resumeTimer);
+        m_resumeTimer = nullptr;
+    }
+    m_interrupted = false;
+}
+
+gboolean SessionEntry::onResumeTimeoutWrapper(gpointer data)
+{
+    static_cast<SessionEntry *>(data)->onResumeTimeout();
+
+    return FALSE;
+}
+
+void SessionEntry::onResumeTimeout()
+{
+    m_resumeTimer = nullptr;
+
+    frida_session_resume(m_handle, nullptr, onResumeReadyWrapper, this);
+}
+
+void SessionEntry::onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    if (g_object_get_data(obj, "qsession") != nullptr) {
+        static_cast<SessionEntry *>(data)->onResumeReady(res);
+    }
+}
+
+void SessionEntry::onResumeReady(GAsyncResult *res)
+{
+    GError *error = nullptr;
+    frida_session_resume_finish(m_handle, res, &error);
+
+    if (!m_interrupted) {
+        g_clear_error(&error);
+        return;
+    }
+
+    if (error == nullptr) {
+        m_interrupted = false;
+
+        for (ScriptEntry *script : std::as_const(m_scripts))
+            script->notifySessionResumed();
+        return;
+    }
+
+    g_clear_error(&error);
+
+    if (g_get_monotonic_time() < m_resumeDeadline) {
+        scheduleResume();
+    } else {
+        m_persistTimeout = 0;
+        onDetached(DetachReason::ConnectionTerminated);
+    }
+}
+
 ScriptEntry::ScriptEntry(SessionEntry *session, ScriptInstance *wrapper, QObject *parent) :
     QObject(parent),
     m_status(ScriptInstance::Status::Loading),
     m_session(session),
     m_wrapper(wrapper),
     m_runtime(Script::Runtime::Default),
+    m_encoding(Script::Encoding::Json),
+    m_cacheRequest(0),
+    m_fromCache(false),
+    m_reloading(false),
+    m_reloadPending(false),
+    m_stageStartTime(g_get_monotonic_time()),
     m_handle(nullptr),
-    m_sessionHandle(nullptr)
+    m_messageHandler(0),
+    m_sessionHandle(nullptr),
+    m_interrupted(false)
 {
+    m_route.wrapper = wrapper;
+    m_route.pid = session->pid();
 }
 
 ScriptEntry::~ScriptEntry()
 {
-    if (m_handle != nullptr) {
-        frida_script_unload(m_handle, nullptr, nullptr, nullptr);
+    if (m_messageQueue != nullptr)
+        m_messageQueue->close();
 
-        g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onMessage), this);
+    releaseHandle();
+}
 
-        g_object_set_data(G_OBJECT(m_handle), "qscript", nullptr);
-        g_object_unref(m_handle);
-    }
+void ScriptEntry::releaseHandle()
+{
+    if (m_handle == nullptr)
+        return;
+
+    frida_script_unload(m_handle, nullptr, nullptr, nullptr);
+
+    g_signal_handler_disconnect(m_handle, m_messageHandler);
+
+    g_object_set_data(G_OBJECT(m_handle), "qscript", nullptr);
+    g_clear_object(&m_handle);
 }
 
 void ScriptEntry::updateSessionHandle(FridaSession *sessionHandle)
 {
     m_sessionHandle = sessionHandle;
+    // A cache lookup still in flight was for the previous session.
+    m_cacheRequest++;
+    if (sessionHandle != nullptr)
+        reportTiming("attach");
     start();
 }
 
@@ -459,12 +1082,54 @@ void ScriptEntry::notifySessionError(QString message)
     updateStatus(ScriptInstance::Status::Error);
 }
 
-void ScriptEntry::post(QJsonValue value)
+void ScriptEntry::notifySessionInterrupted()
 {
+    m_interrupted = true;
+
+    invokeQueued(m_wrapper, "onInterrupted",
+        Q_ARG(bool, true));
+}
+
+void ScriptEntry::notifySessionResumed()
+{
+    m_interrupted = false;
+
+    invokeQueued(m_wrapper, "onInterrupted",
+        Q_ARG(bool, false));
+
     if (m_status == ScriptInstance::Status::Started) {
-        performPost(value);
-    } else if (m_status < ScriptInstance::Status::Started) {
-        m_pending.enqueue(value);
+        while (!m_pending.isEmpty()) {
+            auto pending = m_pending.dequeue();
+            performPost(pending.first, pending.second);
+        }
+    }
+}
+
+void ScriptEntry::post(QJsonValue value)
+{
+    enqueuePost(value, false);
+}
+
+void ScriptEntry::call(int id, QJsonValue request)
+{
+    m_rpcCalls.insert(id);
+    enqueuePost(request, true);
+}
+
+void ScriptEntry::abandonCall(int id)
+{
+    // Its reply may still be on the way, and is dropped rather than
+    // surfacing as an ordinary message.
+    if (m_rpcCalls.remove(id))
+        m_abandonedRpcCalls.insert(id);
+}
+
+void ScriptEntry::enqueuePost(QJsonValue value, bool rpc)
+{
+    if (m_status == ScriptInstance::Status::Started && !m_interrupted) {
+        performPost(value, rpc);
+    } else if (m_status <= ScriptInstance::Status::Started) {
+        m_pending.enqueue(qMakePair(value, rpc));
     } else {
         // Drop silently
     }
@@ -486,6 +1151,16 @@ void ScriptEntry::disableDebugger()
   frida_script_disable_debugger(m_handle, nullptr, nullptr, nullptr);
 }
 
+void ScriptEntry::attachLogSink(std::shared_ptr<LogBuffer> buffer)
+{
+    m_route.logBuffer = buffer;
+}
+
+void ScriptEntry::attachMessageTaps(MessageTapList taps)
+{
+    m_route.taps = taps;
+}
+
 void ScriptEntry::updateStatus(ScriptInstance::Status status)
 {
     if (status == m_status)
@@ -493,17 +1168,39 @@ void ScriptEntry::updateStatus(ScriptInstance::Status status)
 
     m_status = status;
 
-    QMetaObject::invokeMethod(m_wrapper, "onStatus", Qt::QueuedConnection,
+    switch (status) {
+    case ScriptInstance::Status::Compiling:
+        m_stageStartTime = g_get_monotonic_time();
+        break;
+    case ScriptInstance::Status::Starting:
+        reportTiming("compile");
+        break;
+    case ScriptInstance::Status::Started:
+        reportTiming("load");
+        break;
+    default:
+        break;
+    }
+
+    invokeQueued(m_wrapper, "onStatus",
         Q_ARG(ScriptInstance::Status, status));
 
-    if (status == ScriptInstance::Status::Started) {
-        while (!m_pending.isEmpty())
-            performPost(m_pending.dequeue());
+    if (status == ScriptInstance::Status::Started && !m_interrupted) {
+        while (!m_pending.isEmpty()) {
+            auto pending = m_pending.dequeue();
+            performPost(pending.first, pending.second);
+        }
     } else if (status > ScriptInstance::Status::Started) {
         m_pending.clear();
     }
 }
 
+void ScriptEntry::reportTiming(const char *stage)
+{
+    ::reportTiming(m_wrapper, stage, m_stageStartTime);
+    m_stageStartTime = g_get_monotonic_time();
+}
+
 void ScriptEntry::updateError(GError *error)
 {
     updateError(QString::fromUtf8(error->message));
@@ -511,11 +1208,12 @@ void ScriptEntry::updateError(GError *error)
 
 void ScriptEntry::updateError(QString message)
 {
-    QMetaObject::invokeMethod(m_wrapper, "onError", Qt::QueuedConnection,
+    invokeQueued(m_wrapper, "onError",
         Q_ARG(QString, message));
 }
 
-void ScriptEntry::load(QString name, Script::Runtime runtime, QByteArray code)
+void ScriptEntry::load(QString name, Script::Runtime runtime, QByteArray code, std::shared_ptr<QFile> codeMapping,
+    std::shared_ptr<BytecodeCache> bytecodeCache, bool offloadMessages, Script::Encoding encoding)
 {
     if (m_status != ScriptInstance::Status::Loading)
         return;
@@ -523,51 +1221,200 @@ void ScriptEntry::load(QString name, Script::Runtime runtime, QByteArray code)
     m_name = name;
     m_runtime = runtime;
     m_code = code;
+    m_codeMapping = codeMapping;
+    m_bytecodeCache = bytecodeCache;
+    m_encoding = encoding;
+    m_route.cborPayloads = encoding == Script::Encoding::Cbor;
+    // A device with its own thread decodes there, keeping a busy device's
+    // messages from delaying those of the others.
+    auto decodeContext = m_session->device()->decodeContext();
+    if (decodeContext != nullptr || offloadMessages)
+        m_messageQueue = std::make_shared<MessageQueue>(decodeContext);
     updateStatus(ScriptInstance::Status::Loaded);
 
     start();
 }
 
-void ScriptEntry::start()
+void ScriptEntry::reload(QByteArray code, std::shared_ptr<QFile> codeMapping,
+    std::shared_ptr<BytecodeCache> bytecodeCache)
 {
-    if (m_status == ScriptInstance::Status::Loading)
+    switch (m_status) {
+    case ScriptInstance::Status::Loading:
+    case ScriptInstance::Status::Destroyed:
         return;
+    default:
+        break;
+    }
 
-    if (m_sessionHandle != nullptr) {
-        updateStatus(ScriptInstance::Status::Compiling);
+    m_code = code;
+    m_codeMapping = codeMapping;
+    m_bytecodeCache = bytecodeCache;
 
-        QByteArray code = m_code;
+    switch (m_status) {
+    case ScriptInstance::Status::Compiling:
+    case ScriptInstance::Status::Starting:
+        m_reloadPending = true;
+        break;
+    case ScriptInstance::Status::Started:
+        restart();
+        break;
+    default:
+        // Not created yet, start() will pick up the new code.
+        break;
+    }
+}
 
-        auto options = frida_script_options_new();
+void ScriptEntry::restart()
+{
+    m_reloadPending = false;
 
-        if (!m_name.isEmpty()) {
-            std::string name = m_name.toStdString();
-            frida_script_options_set_name(options, name.c_str());
-        }
+    if (m_sessionHandle == nullptr)
+        return;
 
-        frida_script_options_set_runtime(options, static_cast<FridaScriptRuntime>(m_runtime));
+    // The current script keeps running until its replacement has been
+    // created, so a broken edit leaves the instance intact.
+    m_reloading = true;
+    start();
+}
+
+void ScriptEntry::start()
+{
+    if (m_status == ScriptInstance::Status::Loading)
+        return;
+
+    if (m_sessionHandle != nullptr) {
+        updateStatus(ScriptInstance::Status::Compiling);
 
         if (m_code.startsWith(QUICKJS_BYTECODE_MAGIC)) {
-            QByteArray *code = new QByteArray(m_code);
-            GBytes *bytes = g_bytes_new_with_free_func(code->data(), code->size(), deleteByteArray, code);
-            frida_session_create_script_from_bytes(m_sessionHandle, bytes, options, nullptr,
-                onCreateFromBytesReadyWrapper, this);
+            auto buffer = new ScriptCodeBuffer { m_code, m_codeMapping };
+            GBytes *bytes = g_bytes_new_with_free_func(buffer->code.constData(), buffer->code.size(),
+                deleteScriptCodeBuffer, buffer);
+            createFromBytes(bytes);
+            g_bytes_unref(bytes);
+        } else if (m_bytecodeCache != nullptr) {
+            startFromCache();
         } else {
-            std::string source = QString::fromUtf8(m_code).toStdString();
-            frida_session_create_script(m_sessionHandle, source.c_str(), options, nullptr,
-                onCreateFromSourceReadyWrapper, this);
+            createFromSource();
         }
-
-        g_object_unref(options);
     } else {
         updateStatus(ScriptInstance::Status::Establishing);
     }
 }
 
-static void deleteByteArray(gpointer data)
+void ScriptEntry::startFromCache()
+{
+    QPointer<ScriptEntry> self(this);
+    auto request = ++m_cacheRequest;
+    m_session->device()->queryServerVersion([=] (QString fridaVersion) {
+        if (!self.isNull() && request == self->m_cacheRequest)
+            self->lookUpCache(fridaVersion);
+    });
+}
+
+void ScriptEntry::lookUpCache(QString fridaVersion)
+{
+    // Hashing the code and reading the cache file are kept off frida's
+    // thread, which every device shares.
+    QPointer<ScriptEntry> self(this);
+    auto request = m_cacheRequest;
+    auto cache = m_bytecodeCache;
+    auto deviceId = m_session->device()->id();
+    QThreadPool::globalInstance()->start([=] () {
+        auto cacheKey = cache->cacheKey(deviceId, fridaVersion);
+        auto bytecode = cache->load(cacheKey);
+
+        MainContext fridaContext(frida_get_main_context());
+        fridaContext.schedule([=] () {
+            if (!self.isNull())
+                self->onCacheLookupComplete(request, cacheKey, bytecode);
+        });
+    });
+}
+
+void ScriptEntry::onCacheLookupComplete(int request, QByteArray cacheKey, QByteArray bytecode)
+{
+    if (request != m_cacheRequest)
+        return;
+
+    if (m_status == ScriptInstance::Status::Destroyed) {
+        Q_EMIT stopped();
+        return;
+    }
+
+    // The code changed while we were looking, so the key is stale.
+    if (m_reloadPending) {
+        restart();
+        return;
+    }
+
+    m_cacheKey = cacheKey;
+
+    if (!bytecode.isEmpty()) {
+        m_fromCache = true;
+        auto buffer = new ScriptCodeBuffer { bytecode, nullptr };
+        GBytes *bytes = g_bytes_new_with_free_func(buffer->code.constData(), buffer->code.size(),
+            deleteScriptCodeBuffer, buffer);
+        createFromBytes(bytes);
+        g_bytes_unref(bytes);
+        return;
+    }
+
+    compileForCache();
+}
+
+void ScriptEntry::compileForCache()
+{
+    auto options = createOptions();
+    std::string source(m_code.constData(), m_code.size());
+    frida_session_compile_script(m_sessionHandle, source.c_str(), options, nullptr,
+        onCompileReadyWrapper, this);
+    g_object_unref(options);
+}
+
+FridaScriptOptions *ScriptEntry::createOptions() const
+{
+    auto options = frida_script_options_new();
+
+    if (!m_name.isEmpty()) {
+        std::string name = m_name.toStdString();
+        frida_script_options_set_name(options, name.c_str());
+    }
+
+    frida_script_options_set_runtime(options, static_cast<FridaScriptRuntime>(m_runtime));
+
+    return options;
+}
+
+void ScriptEntry::createFromSource()
 {
-    QByteArray *array = static_cast<QByteArray *>(data);
-    delete array;
+    auto options = createOptions();
+    std::string source(m_code.constData(), m_code.size());
+    frida_session_create_script(m_sessionHandle, source.c_str(), options, nullptr,
+        onCreateFromSourceReadyWrapper, this);
+    g_object_unref(options);
+}
+
+void ScriptEntry::createFromBytes(GBytes *bytes)
+{
+    auto options = createOptions();
+    frida_session_create_script_from_bytes(m_sessionHandle, bytes, options, nullptr,
+        onCreateFromBytesReadyWrapper, this);
+    g_object_unref(options);
+}
+
+static void deleteScriptCodeBuffer(gpointer data)
+{
+    auto buffer = static_cast<ScriptCodeBuffer *>(data);
+    delete buffer;
+}
+
+static void reportTiming(ScriptInstance *wrapper, const char *stage, gint64 startTime)
+{
+    FRIDAQML_TRACE_SINCE(stage, startTime);
+
+    invokeQueued(wrapper, "onTiming",
+        Q_ARG(QString, QString::fromUtf8(stage)),
+        Q_ARG(double, (g_get_monotonic_time() - startTime) / 1000.0));
 }
 
 void ScriptEntry::stop()
@@ -580,6 +1427,47 @@ void ScriptEntry::stop()
         Q_EMIT stopped();
 }
 
+void ScriptEntry::onCompileReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    if (g_object_get_data(obj, "qsession") != nullptr) {
+        static_cast<ScriptEntry *>(data)->onCompileReady(res);
+    }
+}
+
+void ScriptEntry::onCompileReady(GAsyncResult *res)
+{
+    GError *error = nullptr;
+    GBytes *bytes = frida_session_compile_script_finish(m_sessionHandle, res, &error);
+
+    if (m_status == ScriptInstance::Status::Destroyed) {
+        g_clear_pointer(&bytes, g_bytes_unref);
+        g_clear_error(&error);
+
+        Q_EMIT stopped();
+        return;
+    }
+
+    if (error == nullptr) {
+        gsize size;
+        auto data = static_cast<const char *>(g_bytes_get_data(bytes, &size));
+        // A reload that came in meanwhile has already swapped the cache out.
+        if (!m_reloadPending) {
+            auto cache = m_bytecodeCache;
+            auto cacheKey = m_cacheKey;
+            QByteArray bytecode(data, size);
+            QThreadPool::globalInstance()->start([=] () { cache->store(cacheKey, bytecode); });
+        }
+
+        createFromBytes(bytes);
+        g_bytes_unref(bytes);
+    } else {
+        // Let creation from source report the error, or succeed where the
+        // runtime does not support compilation.
+        g_clear_error(&error);
+        createFromSource();
+    }
+}
+
 void ScriptEntry::onCreateFromSourceReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
 {
     if (g_object_get_data(obj, "qsession") != nullptr) {
@@ -605,11 +1493,39 @@ void ScriptEntry::onCreateFromBytesReady(GAsyncResult *res)
 {
     GError *error = nullptr;
     FridaScript *handle = frida_session_create_script_from_bytes_finish(m_sessionHandle, res, &error);
+
+    auto fromCache = m_fromCache;
+    m_fromCache = false;
+
+    // Servers that don't report their version are keyed by id alone, so an
+    // upgrade can leave cached bytecode behind that its runtime no longer
+    // accepts. Compiled afresh once the stale entry is gone.
+    if (fromCache && error != nullptr && m_status != ScriptInstance::Status::Destroyed) {
+        g_clear_error(&error);
+
+        QPointer<ScriptEntry> self(this);
+        auto request = ++m_cacheRequest;
+        auto cache = m_bytecodeCache;
+        auto cacheKey = m_cacheKey;
+        QThreadPool::globalInstance()->start([=] () {
+            cache->discard(cacheKey);
+
+            MainContext fridaContext(frida_get_main_context());
+            fridaContext.schedule([=] () {
+                if (!self.isNull())
+                    self->onCacheLookupComplete(request, cacheKey, QByteArray());
+            });
+        });
+        return;
+    }
+
     onCreateComplete(&handle, &error);
 }
 
 void ScriptEntry::onCreateComplete(FridaScript **handle, GError **error)
 {
+    FRIDAQML_TRACE_SCOPE("ScriptEntry.onCreateComplete");
+
     if (m_status == ScriptInstance::Status::Destroyed) {
         g_clear_object(handle);
         g_clear_error(error);
@@ -618,14 +1534,34 @@ void ScriptEntry::onCreateComplete(FridaScript **handle, GError **error)
         return;
     }
 
+    auto reloading = m_reloading;
+    m_reloading = false;
+
     if (*error == nullptr) {
+        if (reloading) {
+            releaseHandle();
+
+            QList<int> abortedRpcCalls(m_rpcCalls.cbegin(), m_rpcCalls.cend());
+            m_rpcCalls.clear();
+            m_abandonedRpcCalls.clear();
+            invokeQueued(m_wrapper, "onReloaded",
+                Q_ARG(QList<int>, abortedRpcCalls));
+        }
+
         m_handle = static_cast<FridaScript *>(g_steal_pointer(handle));
         g_object_set_data(G_OBJECT(m_handle), "qscript", this);
 
-        g_signal_connect_swapped(m_handle, "message", G_CALLBACK(onMessage), this);
+        m_messageHandler = g_signal_connect_swapped(m_handle, "message", G_CALLBACK(onMessageWrapper), this);
 
         updateStatus(ScriptInstance::Status::Starting);
         frida_script_load(m_handle, nullptr, onLoadReadyWrapper, this);
+    } else if (reloading) {
+        updateError(*error);
+        updateStatus(ScriptInstance::Status::Started);
+        g_clear_error(error);
+
+        if (m_reloadPending)
+            restart();
     } else {
         updateError(*error);
         updateStatus(ScriptInstance::Status::Error);
@@ -642,6 +1578,8 @@ void ScriptEntry::onLoadReadyWrapper(GObject *obj, GAsyncResult *res, gpointer d
 
 void ScriptEntry::onLoadReady(GAsyncResult *res)
 {
+    FRIDAQML_TRACE_SCOPE("ScriptEntry.onLoadReady");
+
     GError *error = nullptr;
     frida_script_load_finish(m_handle, res, &error);
 
@@ -654,6 +1592,9 @@ void ScriptEntry::onLoadReady(GAsyncResult *res)
 
     if (error == nullptr) {
         updateStatus(ScriptInstance::Status::Started);
+
+        if (m_reloadPending)
+            restart();
     } else {
         updateError(error);
         updateStatus(ScriptInstance::Status::Error);
@@ -661,8 +1602,18 @@ void ScriptEntry::onLoadReady(GAsyncResult *res)
     }
 }
 
-void ScriptEntry::performPost(QJsonValue value)
+void ScriptEntry::performPost(QJsonValue value, bool rpc)
 {
+    // The agent picks these up with recv('$cbor', ...); RPC stays on JSON
+    // as that is what frida's RPC handler speaks.
+    if (m_encoding == Script::Encoding::Cbor && !rpc) {
+        auto payload = QCborValue::fromJsonValue(value).toCbor();
+        auto bytes = g_bytes_new(payload.constData(), payload.size());
+        frida_script_post(m_handle, "{\"type\":\"$cbor\"}", bytes);
+        g_bytes_unref(bytes);
+        return;
+    }
+
     QJsonDocument document = value.isObject()
         ? QJsonDocument(value.toObject())
         : QJsonDocument(value.toArray());
@@ -670,25 +1621,59 @@ void ScriptEntry::performPost(QJsonValue value)
     frida_script_post(m_handle, json.data(), nullptr);
 }
 
-void ScriptEntry::onMessage(ScriptEntry *self, const gchar *message, GBytes *data)
+void ScriptEntry::onMessageWrapper(ScriptEntry *self, const gchar *message, GBytes *data)
+{
+    self->onMessage(message, data);
+}
+
+void ScriptEntry::onMessage(const gchar *message, GBytes *data)
 {
+    FRIDAQML_TRACE_SCOPE("ScriptEntry.onMessage");
+
+    if ((!m_rpcCalls.isEmpty() || !m_abandonedRpcCalls.isEmpty()) && tryDeliverRpcReply(message, data))
+        return;
+
+    if (m_messageQueue != nullptr) {
+        m_messageQueue->push(m_route, message, data);
+        return;
+    }
+
     auto messageJson = QByteArray::fromRawData(message, static_cast<int>(strlen(message)));
-    auto messageDocument = QJsonDocument::fromJson(messageJson);
-    auto messageObject = messageDocument.object();
+    MessageDispatcher::deliver(m_route, messageJson, data);
+}
 
-    if (messageObject["type"] == "log") {
-        std::string logMessage = messageObject["payload"].toString().toStdString();
-        qDebug("%s", logMessage.c_str());
-    } else {
-        QVariant dataValue;
-        if (data != nullptr) {
-            gsize dataSize;
-            auto dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
-            dataValue = QByteArray(dataBuffer, dataSize);
-        }
+bool ScriptEntry::tryDeliverRpcReply(const gchar *message, GBytes *data)
+{
+    // Only messages that mention the RPC marker are worth parsing here.
+    if (strstr(message, "\"frida:rpc\"") == nullptr)
+        return false;
 
-        QMetaObject::invokeMethod(self->m_wrapper, "onMessage", Qt::QueuedConnection,
-            Q_ARG(QJsonObject, messageDocument.object()),
-            Q_ARG(QVariant, dataValue));
+    auto messageJson = QByteArray::fromRawData(message, static_cast<int>(strlen(message)));
+    auto object = QJsonDocument::fromJson(messageJson).object();
+    if (object["type"].toString() != "send")
+        return false;
+
+    auto reply = object["payload"].toArray();
+    if (reply[0].toString() != "frida:rpc" || !reply[1].isDouble())
+        return false;
+
+    auto id = reply[1].toInt();
+    if (m_abandonedRpcCalls.remove(id))
+        return true;
+    if (!m_rpcCalls.remove(id))
+        return false;
+
+    QVariant dataValue;
+    if (data != nullptr) {
+        gsize dataSize;
+        auto dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
+        dataValue = QByteArray(dataBuffer, dataSize);
     }
+
+    invokeQueued(m_wrapper, "onRpcReply",
+        Q_ARG(int, id),
+        Q_ARG(QJsonArray, reply),
+        Q_ARG(QVariant, dataValue));
+
+    return true;
 }
@@ -3,12 +3,17 @@
 
 #include "fridafwd.h"
 #include "iconprovider.h"
+#include "messagedispatcher.h"
 #include "script.h"
 
+#include <functional>
+#include <memory>
 #include <QHash>
 #include <QObject>
 #include <QQueue>
+#include <QSet>
 
+struct DeviceShutdown;
 class MainContext;
 class ScriptEntry;
 class SessionEntry;
@@ -22,6 +27,8 @@ class Device : public QObject
     Q_PROPERTY(QString id READ id NOTIFY idChanged)
     Q_PROPERTY(QString name READ name NOTIFY nameChanged)
     Q_PROPERTY(Type type READ type NOTIFY typeChanged)
+    Q_PROPERTY(int persistTimeout READ persistTimeout WRITE setPersistTimeout NOTIFY persistTimeoutChanged)
+    Q_PROPERTY(bool dedicatedThread READ hasDedicatedThread WRITE setDedicatedThread NOTIFY dedicatedThreadChanged)
     QML_ELEMENT
     QML_UNCREATABLE("Device objects cannot be instantiated from Qml");
 
@@ -40,47 +47,108 @@ public:
     QString name() const { return m_name; }
     QUrl icon() const { return m_icon.url(); }
     Type type() const { return m_type; }
+    int persistTimeout() const { return m_persistTimeout; }
+    void setPersistTimeout(int persistTimeout);
+    bool hasDedicatedThread() const { return !m_decodeContext.isNull(); }
+    void setDedicatedThread(bool dedicatedThread);
+    MainContext *mainContext() const { return m_mainContext.data(); }
+    MainContext *decodeContext() const { return m_decodeContext.data(); }
+    bool isShutDown() const { return m_shutDown; }
+    void queryServerVersion(std::function<void (QString)> callback);
 
     Q_INVOKABLE ScriptInstance *inject(Script *script, QString program, SpawnOptions *options = nullptr);
     Q_INVOKABLE ScriptInstance *inject(Script *script, int pid);
+    Q_INVOKABLE void shutdown(int maxPending = 16, int timeout = 5000);
+
+    void enableChildGating(int pid);
 
 Q_SIGNALS:
     void idChanged(QString newId);
     void nameChanged(QString newName);
     void typeChanged(Type newType);
+    void persistTimeoutChanged(int newPersistTimeout);
+    void dedicatedThreadChanged(bool newDedicatedThread);
+    void shutdownProgress(int completed, int total);
+    void shutdownFinished(int abandoned);
 
 private:
     ScriptInstance *createScriptInstance(Script *script, int pid);
     void performSpawn(QString program, FridaSpawnOptions *options, ScriptInstance *wrapper);
     static void onSpawnReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onSpawnReady(GAsyncResult *res, ScriptInstance *wrapper);
-    void performResume(ScriptInstance *wrapper);
+    void performResume(ScriptInstance *wrapper, int pid);
     static void onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onResumeReady(GAsyncResult *res, ScriptInstance *wrapper);
+    static void onQuerySystemParametersReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onQuerySystemParametersReady(GAsyncResult *res);
     void performInject(int pid, ScriptInstance *wrapper);
+    void performEnableChildGating(int pid);
 private Q_SLOTS:
     void tryPerformLoad(ScriptInstance *wrapper);
 private:
-    void performLoad(ScriptInstance *wrapper, QString name, Script::Runtime runtime, QByteArray code);
-    void performStop(ScriptInstance *wrapper);
+    std::function<void ()> prepareLoad(ScriptInstance *wrapper);
+    void performLoad(ScriptInstance *wrapper, QString name, Script::Runtime runtime, QByteArray code,
+        std::shared_ptr<QFile> codeMapping, std::shared_ptr<BytecodeCache> bytecodeCache, bool offloadMessages,
+        Script::Encoding encoding);
+    void tryPerformReload(ScriptInstance *wrapper);
+    void performReload(ScriptInstance *wrapper, QByteArray code, std::shared_ptr<QFile> codeMapping,
+        std::shared_ptr<BytecodeCache> bytecodeCache);
+    void beginStopBatch();
+    void endStopBatch();
+    void requestStop(ScriptInstance *wrapper);
+    void flushStops();
+    void performStop(QList<ScriptInstance *> wrappers);
     void performPost(ScriptInstance *wrapper, QJsonValue value);
+    void performRpcCall(ScriptInstance *wrapper, int id, QJsonValue request);
+    void performAbandonRpcCall(ScriptInstance *wrapper, int id);
     void performEnableDebugger(ScriptInstance *wrapper, quint16 port);
     void performDisableDebugger(ScriptInstance *wrapper);
+    void performAttachLogSink(ScriptInstance *wrapper, std::shared_ptr<LogBuffer> buffer);
+    void performAttachMessageTaps(ScriptInstance *wrapper, MessageTapList taps);
     void scheduleGarbageCollect();
     static gboolean onGarbageCollectTimeoutWrapper(gpointer data);
     void onGarbageCollectTimeout();
+    void performShutdown(int maxPending, int timeout);
+    void detachNext(DeviceShutdown *shutdown);
+    static void onDetachReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onDetachReady(DeviceShutdown *shutdown);
+    static gboolean onShutdownDeadlineWrapper(gpointer data);
+    void finishShutdown(DeviceShutdown *shutdown, int abandoned);
+    static void abandonShutdown(DeviceShutdown *shutdown);
+    static void releaseShutdown(DeviceShutdown *shutdown);
+
+private Q_SLOTS:
+    void onShutdownFinished(int abandoned);
 
+private:
     FridaDevice *m_handle;
     QString m_id;
     QString m_name;
     Icon m_icon;
     Type m_type;
+    int m_persistTimeout;
+    int m_sessionPersistTimeout;
+    bool m_injected;
+    QString m_serverVersion;
+    bool m_serverVersionKnown;
+    QList<std::function<void (QString)>> m_serverVersionRequests;
 
     QHash<int, SessionEntry *> m_sessions;
     QHash<ScriptInstance *, ScriptEntry *> m_scripts;
+    QHash<ScriptInstance *, std::function<void ()>> m_pendingLoads;
+    QSet<ScriptInstance *> m_spawning;
+    QHash<ScriptInstance *, gint64> m_stageStartTimes;
     GSource *m_gcTimer;
+    QList<ScriptInstance *> m_pendingStops;
+    int m_stopBatchDepth;
+    bool m_shuttingDown;
+    bool m_shutDown;
+    DeviceShutdown *m_shutdown;
 
     QScopedPointer<MainContext> m_mainContext;
+    QScopedPointer<MainContext> m_decodeContext;
+
+    friend class Script;
 };
 
 class SessionEntry : public QObject
@@ -98,13 +166,17 @@ public:
     };
     Q_ENUM(DetachReason)
 
-    explicit SessionEntry(Device *device, int pid, QObject *parent = nullptr);
+    explicit SessionEntry(Device *device, int pid, int persistTimeout, QObject *parent = nullptr);
     ~SessionEntry();
 
+    Device *device() const { return m_device; }
+    int pid() const { return m_pid; }
     QList<ScriptEntry *> scripts() const { return m_scripts; }
 
     ScriptEntry *add(ScriptInstance *wrapper);
     void remove(ScriptEntry *script);
+    FridaSession *takeHandle();
+    void enableChildGating();
 
 Q_SIGNALS:
     void detached(DetachReason reason);
@@ -112,13 +184,26 @@ Q_SIGNALS:
 private:
     static void onAttachReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onAttachReady(GAsyncResult *res);
-    static void onDetachedWrapper(SessionEntry *self, int reason, FridaCrash * crash);
+    static void onDetachedWrapper(SessionEntry *self, int reason, FridaCrash *crash);
     void onDetached(DetachReason reason);
+    void scheduleResume();
+    void cancelResume();
+    static gboolean onResumeTimeoutWrapper(gpointer data);
+    void onResumeTimeout();
+    static void onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onResumeReady(GAsyncResult *res);
 
     Device *m_device;
     int m_pid;
+    int m_persistTimeout;
     FridaSession *m_handle;
+    gulong m_detachedHandler;
     QList<ScriptEntry *> m_scripts;
+    bool m_childGating;
+    bool m_interrupted;
+    gint64 m_resumeDeadline;
+    guint m_resumeDelay;
+    GSource *m_resumeTimer;
 };
 
 class ScriptEntry : public QObject
@@ -136,11 +221,19 @@ public:
     void updateSessionHandle(FridaSession *sessionHandle);
     void notifySessionError(GError *error);
     void notifySessionError(QString message);
-    void load(QString name, Script::Runtime runtime, QByteArray code);
+    void notifySessionInterrupted();
+    void notifySessionResumed();
+    void load(QString name, Script::Runtime runtime, QByteArray code, std::shared_ptr<QFile> codeMapping,
+        std::shared_ptr<BytecodeCache> bytecodeCache, bool offloadMessages, Script::Encoding encoding);
+    void reload(QByteArray code, std::shared_ptr<QFile> codeMapping, std::shared_ptr<BytecodeCache> bytecodeCache);
     void stop();
     void post(QJsonValue value);
+    void call(int id, QJsonValue request);
+    void abandonCall(int id);
     void enableDebugger(quint16 port);
     void disableDebugger();
+    void attachLogSink(std::shared_ptr<LogBuffer> buffer);
+    void attachMessageTaps(MessageTapList taps);
 
 Q_SIGNALS:
     void stopped();
@@ -149,8 +242,20 @@ private:
     void updateStatus(ScriptInstance::Status status);
     void updateError(GError *error);
     void updateError(QString message);
+    void reportTiming(const char *stage);
 
     void start();
+    void restart();
+    void releaseHandle();
+    void startFromCache();
+    void lookUpCache(QString fridaVersion);
+    void onCacheLookupComplete(int request, QByteArray cacheKey, QByteArray bytecode);
+    void compileForCache();
+    FridaScriptOptions *createOptions() const;
+    void createFromSource();
+    void createFromBytes(GBytes *bytes);
+    static void onCompileReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onCompileReady(GAsyncResult *res);
     static void onCreateFromSourceReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onCreateFromSourceReady(GAsyncResult *res);
     static void onCreateFromBytesReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
@@ -158,18 +263,36 @@ private:
     void onCreateComplete(FridaScript **handle, GError **error);
     static void onLoadReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onLoadReady(GAsyncResult *res);
-    void performPost(QJsonValue value);
-    static void onMessage(ScriptEntry *self, const gchar *message, GBytes *data);
+    void enqueuePost(QJsonValue value, bool rpc);
+    void performPost(QJsonValue value, bool rpc);
+    static void onMessageWrapper(ScriptEntry *self, const gchar *message, GBytes *data);
+    void onMessage(const gchar *message, GBytes *data);
+    bool tryDeliverRpcReply(const gchar *message, GBytes *data);
 
     ScriptInstance::Status m_status;
     SessionEntry *m_session;
     ScriptInstance *m_wrapper;
     QString m_name;
     Script::Runtime m_runtime;
+    Script::Encoding m_encoding;
     QByteArray m_code;
+    std::shared_ptr<QFile> m_codeMapping;
+    std::shared_ptr<BytecodeCache> m_bytecodeCache;
+    QByteArray m_cacheKey;
+    int m_cacheRequest;
+    bool m_fromCache;
+    bool m_reloading;
+    bool m_reloadPending;
+    gint64 m_stageStartTime;
     FridaScript *m_handle;
+    gulong m_messageHandler;
     FridaSession *m_sessionHandle;
-    QQueue<QJsonValue> m_pending;
+    QQueue<QPair<QJsonValue, bool>> m_pending;
+    bool m_interrupted;
+    std::shared_ptr<MessageQueue> m_messageQueue;
+    MessageRoute m_route;
+    QSet<int> m_rpcCalls;
+    QSet<int> m_abandonedRpcCalls;
 };
 
 #endif
@@ -4,6 +4,10 @@
 
 #include "device.h"
 #include "frida.h"
+#include "tracing.h"
+
+#include <algorithm>
+#include <functional>
 
 static const int DeviceNameRole = Qt::UserRole + 0;
 static const int DeviceIconRole = Qt::UserRole + 1;
@@ -14,8 +18,9 @@ DeviceListModel::DeviceListModel(QObject *parent) :
 {
     auto frida = Frida::instance();
     m_devices = frida->deviceItems();
-    connect(frida, &Frida::deviceAdded, this, &DeviceListModel::onDeviceAdded);
-    connect(frida, &Frida::deviceRemoved, this, &DeviceListModel::onDeviceRemoved);
+    reindex(0);
+    connect(frida, &Frida::devicesAdded, this, &DeviceListModel::onDevicesAdded);
+    connect(frida, &Frida::devicesRemoved, this, &DeviceListModel::onDevicesRemoved);
 }
 
 Device *DeviceListModel::get(int index) const
@@ -59,20 +64,62 @@ QVariant DeviceListModel::data(const QModelIndex &index, int role) const
     }
 }
 
-void DeviceListModel::onDeviceAdded(Device *device)
+void DeviceListModel::onDevicesAdded(QList<Device *> devices)
 {
+    FRIDAQML_TRACE_SCOPE("DeviceListModel.onDevicesAdded");
+
+    // The initial snapshot may already include part of the first batch.
+    devices.removeIf([this] (Device *device) { return m_rows.contains(device); });
+    if (devices.isEmpty())
+        return;
+
     auto rowIndex = m_devices.size();
-    beginInsertRows(QModelIndex(), rowIndex, rowIndex);
-    m_devices.append(device);
+    beginInsertRows(QModelIndex(), rowIndex, rowIndex + devices.size() - 1);
+    m_devices.append(devices);
+    reindex(rowIndex);
     endInsertRows();
     Q_EMIT countChanged(m_devices.count());
 }
 
-void DeviceListModel::onDeviceRemoved(Device *device)
+void DeviceListModel::onDevicesRemoved(QList<Device *> devices)
 {
-    auto rowIndex = m_devices.indexOf(device);
-    beginRemoveRows(QModelIndex(), rowIndex, rowIndex);
-    m_devices.removeAt(rowIndex);
-    endRemoveRows();
+    FRIDAQML_TRACE_SCOPE("DeviceListModel.onDevicesRemoved");
+
+    QList<int> rows;
+    rows.reserve(devices.size());
+    for (Device *device : std::as_const(devices)) {
+        auto it = m_rows.constFind(device);
+        if (it != m_rows.constEnd())
+            rows.append(it.value());
+    }
+    if (rows.isEmpty())
+        return;
+
+    // Remove contiguous runs from the bottom up so earlier rows keep their
+    // index, then renumber what follows the first gap once.
+    std::sort(rows.begin(), rows.end(), std::greater<int>());
+    int i = 0;
+    while (i != rows.size()) {
+        int last = rows[i];
+        int first = last;
+        while (i + 1 != rows.size() && rows[i + 1] == first - 1)
+            first = rows[++i];
+        i++;
+
+        beginRemoveRows(QModelIndex(), first, last);
+        for (int row = first; row <= last; row++)
+            m_rows.remove(m_devices[row]);
+        m_devices.remove(first, last - first + 1);
+        endRemoveRows();
+    }
+    reindex(rows.last());
+
     Q_EMIT countChanged(m_devices.count());
 }
+
+void DeviceListModel::reindex(int from)
+{
+    auto size = m_devices.size();
+    for (int i = from; i != size; i++)
+        m_rows[m_devices[i]] = i;
+}
@@ -28,11 +28,14 @@ Q_SIGNALS:
     void countChanged(int newCount);
 
 private Q_SLOTS:
-    void onDeviceAdded(Device *device);
-    void onDeviceRemoved(Device *device);
+    void onDevicesAdded(QList<Device *> devices);
+    void onDevicesRemoved(QList<Device *> devices);
 
 private:
+    void reindex(int from);
+
     QList<Device *> m_devices;
+    QHash<Device *, int> m_rows;
 };
 
 #endif
@@ -5,12 +5,34 @@
 #include "device.h"
 #include "devicelistmodel.h"
 #include "maincontext.h"
+#include "stats.h"
+#include "tracing.h"
 
 Frida *Frida::s_instance = nullptr;
 
+struct AddRemoteDeviceRequest
+{
+    Frida *frida;
+    QString address;
+    bool cancelled;
+};
+
+struct CloseManagerRequest
+{
+    Frida *frida;
+    GCancellable *cancellable;
+    GSource *timer;
+};
+
 Frida::Frida(QObject *parent) :
     QObject(parent),
+    m_flushScheduled(false),
     m_localSystem(nullptr),
+    m_stats(new Stats(this)),
+    m_shuttingDown(false),
+    m_closed(false),
+    m_shutdownAbandoned(0),
+    m_closeRequest(nullptr),
     m_mainContext(nullptr)
 {
     frida_init();
@@ -37,6 +59,18 @@ void Frida::initialize()
 
 void Frida::dispose()
 {
+    if (m_closeRequest != nullptr) {
+        if (m_closeRequest->timer != nullptr)
+            g_source_destroy(m_closeRequest->timer);
+        m_closeRequest->timer = nullptr;
+        m_closeRequest->frida = nullptr;
+        m_closeRequest = nullptr;
+    }
+
+    for (AddRemoteDeviceRequest *request : std::as_const(m_addRemoteDeviceRequests))
+        request->frida = nullptr;
+    m_addRemoteDeviceRequests.clear();
+
     g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onDeviceRemovedWrapper), this);
     g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onDeviceAddedWrapper), this);
     g_object_unref(m_handle);
@@ -45,11 +79,18 @@ void Frida::dispose()
 
 Frida::~Frida()
 {
+    m_shutdownDevices.clear();
     m_localSystem = nullptr;
     qDeleteAll(m_deviceItems);
     m_deviceItems.clear();
-
-    frida_device_manager_close_sync(m_handle, nullptr, nullptr);
+    m_devicesById.clear();
+    qDeleteAll(m_pendingDeletes);
+    m_pendingDeletes.clear();
+    qDeleteAll(m_retiringDevices);
+    m_retiringDevices.clear();
+
+    if (!m_closed)
+        frida_device_manager_close_sync(m_handle, nullptr, nullptr);
     m_mainContext->perform([this] () { dispose(); });
     m_mainContext.reset();
 
@@ -87,7 +128,7 @@ void Frida::onGetLocalDeviceReady(GAsyncResult *res)
         m_localSystemAvailable.wakeOne();
     }
 
-    QMetaObject::invokeMethod(this, "add", Qt::QueuedConnection, Q_ARG(Device *, device));
+    invokeQueued(this, "add", Q_ARG(Device *, device));
 
     g_object_unref(deviceHandle);
 }
@@ -127,36 +168,405 @@ void Frida::onDeviceRemovedWrapper(Frida *self, FridaDevice *deviceHandle)
 
 void Frida::onDeviceAdded(FridaDevice *deviceHandle)
 {
-    if (deviceHandle == m_localSystem->handle())
+    // Keyed by id, as nothing keeps the handle alive once it's removed.
+    QString id = frida_device_get_id(deviceHandle);
+    if (deviceHandle == m_localSystem->handle() || m_knownDeviceIds.contains(id))
         return;
+    m_knownDeviceIds.insert(id);
 
     auto device = new Device(deviceHandle);
     device->moveToThread(this->thread());
 
-    QMetaObject::invokeMethod(this, "add", Qt::QueuedConnection, Q_ARG(Device *, device));
+    invokeQueued(this, "add", Q_ARG(Device *, device));
 }
 
 void Frida::onDeviceRemoved(FridaDevice *deviceHandle)
 {
-    QMetaObject::invokeMethod(this, "removeById", Qt::QueuedConnection, Q_ARG(QString, frida_device_get_id(deviceHandle)));
+    QString id = frida_device_get_id(deviceHandle);
+    m_knownDeviceIds.remove(id);
+
+    invokeQueued(this, "removeById", Q_ARG(QString, id));
+}
+
+void Frida::addRemoteDevice(QString address, QVariantMap options)
+{
+    // Reuse the connection we already have, or are establishing, so callers
+    // can ask for a host without tracking what they asked for before.
+    auto it = m_remoteDeviceIds.constFind(address);
+    if (it != m_remoteDeviceIds.constEnd()) {
+        if (!it.value().isEmpty())
+            onRemoteDeviceReady(address, it.value());
+        return;
+    }
+    m_remoteDeviceIds[address] = QString();
+
+    m_mainContext->schedule([=] () { performAddRemoteDevice(address, options); });
+}
+
+void Frida::removeRemoteDevice(QString address)
+{
+    if (m_remoteDeviceIds.remove(address) == 0)
+        return;
+
+    m_mainContext->schedule([=] () { performRemoveRemoteDevice(address); });
+}
+
+void Frida::shutdown(int maxPending, int timeout)
+{
+    if (m_shuttingDown)
+        return;
+    m_shuttingDown = true;
+    m_shutdownDeadline = QDeadlineTimer((timeout > 0) ? timeout : -1);
+
+    auto devices = m_retiringDevices;
+    for (Device *device : std::as_const(m_deviceItems))
+        devices.insert(device);
+    for (Device *device : std::as_const(devices))
+        awaitShutdown(device, maxPending, timeout);
+
+    if (m_shutdownDevices.isEmpty())
+        onDeviceShutDown(nullptr);
+}
+
+bool Frida::isTracingAvailable() const
+{
+    return Tracer::isEnabled();
+}
+
+bool Frida::exportTrace(QString path)
+{
+    QString errorMessage;
+    if (!Tracer::exportChromeTrace(path, &errorMessage)) {
+        std::string message = errorMessage.toStdString();
+        qWarning("Unable to export trace: %s", message.c_str());
+        return false;
+    }
+    return true;
+}
+
+void Frida::clearTrace()
+{
+    Tracer::clear();
+}
+
+void Frida::performAddRemoteDevice(QString address, QVariantMap options)
+{
+    // Removed and added again before the first connect finished: keep that
+    // one instead of racing it, as its completion would remove the device.
+    auto pending = m_addRemoteDeviceRequests.value(address);
+    if (pending != nullptr) {
+        pending->cancelled = false;
+        return;
+    }
+
+    auto optionsHandle = frida_remote_device_options_new();
+
+    if (options.contains("token")) {
+        std::string token = options["token"].toString().toStdString();
+        frida_remote_device_options_set_token(optionsHandle, token.c_str());
+    }
+
+    if (options.contains("origin")) {
+        std::string origin = options["origin"].toString().toStdString();
+        frida_remote_device_options_set_origin(optionsHandle, origin.c_str());
+    }
+
+    if (options.contains("keepaliveInterval"))
+        frida_remote_device_options_set_keepalive_interval(optionsHandle, options["keepaliveInterval"].toInt());
+
+    if (options.contains("certificate")) {
+        std::string path = options["certificate"].toString().toStdString();
+        GError *error = nullptr;
+        auto certificate = g_tls_certificate_new_from_file(path.c_str(), &error);
+        if (error != nullptr) {
+            invokeQueued(this, "onRemoteDeviceError",
+                Q_ARG(QString, address),
+                Q_ARG(QString, QString::fromUtf8(error->message)));
+            g_clear_error(&error);
+            g_object_unref(optionsHandle);
+            return;
+        }
+        frida_remote_device_options_set_certificate(optionsHandle, certificate);
+        g_object_unref(certificate);
+    }
+
+    std::string addressStr = address.toStdString();
+    auto request = new AddRemoteDeviceRequest { this, address, false };
+    m_addRemoteDeviceRequests[address] = request;
+    frida_device_manager_add_remote_device(m_handle, addressStr.c_str(), optionsHandle, nullptr,
+        onAddRemoteDeviceReadyWrapper, request);
+
+    g_object_unref(optionsHandle);
+}
+
+void Frida::onAddRemoteDeviceReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    auto request = static_cast<AddRemoteDeviceRequest *>(data);
+
+    if (request->frida != nullptr) {
+        request->frida->onAddRemoteDeviceReady(request, res);
+    } else {
+        auto deviceHandle = frida_device_manager_add_remote_device_finish(FRIDA_DEVICE_MANAGER(obj), res, nullptr);
+        g_clear_object(&deviceHandle);
+    }
+
+    delete request;
+}
+
+void Frida::onAddRemoteDeviceReady(AddRemoteDeviceRequest *request, GAsyncResult *res)
+{
+    auto address = request->address;
+    m_addRemoteDeviceRequests.remove(address);
+
+    GError *error = nullptr;
+    FridaDevice *deviceHandle = frida_device_manager_add_remote_device_finish(m_handle, res, &error);
+
+    // removeRemoteDevice() came in while connecting, which the manager had
+    // nothing to remove for yet.
+    if (request->cancelled) {
+        if (error == nullptr) {
+            g_object_unref(deviceHandle);
+            performRemoveRemoteDevice(address);
+        }
+        g_clear_error(&error);
+        return;
+    }
+
+    if (error == nullptr) {
+        invokeQueued(this, "onRemoteDeviceReady",
+            Q_ARG(QString, address),
+            Q_ARG(QString, QString::fromUtf8(frida_device_get_id(deviceHandle))));
+        g_object_unref(deviceHandle);
+    } else {
+        invokeQueued(this, "onRemoteDeviceError",
+            Q_ARG(QString, address),
+            Q_ARG(QString, QString::fromUtf8(error->message)));
+        g_clear_error(&error);
+    }
+}
+
+void Frida::performRemoveRemoteDevice(QString address)
+{
+    auto pending = m_addRemoteDeviceRequests.value(address);
+    if (pending != nullptr) {
+        pending->cancelled = true;
+        return;
+    }
+
+    std::string addressStr = address.toStdString();
+    frida_device_manager_remove_remote_device(m_handle, addressStr.c_str(), nullptr, nullptr, nullptr);
+}
+
+void Frida::retire(Device *device)
+{
+    if (device->isShutDown()) {
+        delete device;
+        return;
+    }
+
+    // Sessions on the device are detached in the background, so removing a
+    // device with many of them does not stall this thread.
+    m_retiringDevices.insert(device);
+    connect(device, &Device::shutdownFinished, this, [=] () {
+        m_retiringDevices.remove(device);
+        device->deleteLater();
+    });
+    device->shutdown();
+}
+
+void Frida::awaitShutdown(Device *device, int maxPending, int timeout)
+{
+    if (device->isShutDown())
+        return;
+
+    m_shutdownDevices.insert(device);
+    connect(device, &Device::shutdownProgress, this, [=] (int completed, int total) {
+        m_shutdownProgress[device] = qMakePair(completed, total);
+
+        int allCompleted = 0;
+        int allTotal = 0;
+        for (const auto &progress : std::as_const(m_shutdownProgress)) {
+            allCompleted += progress.first;
+            allTotal += progress.second;
+        }
+        Q_EMIT shutdownProgress(allCompleted, allTotal);
+    });
+    connect(device, &Device::shutdownFinished, this, [=] (int abandoned) {
+        m_shutdownAbandoned += abandoned;
+        onDeviceShutDown(device);
+    });
+    connect(device, &QObject::destroyed, this, [=] () { onDeviceShutDown(device); });
+    device->shutdown(maxPending, timeout);
+}
+
+void Frida::onDeviceShutDown(Device *device)
+{
+    if (device != nullptr && !m_shutdownDevices.remove(device))
+        return;
+    if (!m_shutdownDevices.isEmpty())
+        return;
+
+    // Closing the manager gets whatever is left of the deadline.
+    int timeout = 0;
+    if (!m_shutdownDeadline.isForever())
+        timeout = qMax(static_cast<int>(m_shutdownDeadline.remainingTime()), 1);
+    m_mainContext->schedule([=] () { performClose(timeout); });
+}
+
+void Frida::performClose(int timeout)
+{
+    auto request = new CloseManagerRequest { this, g_cancellable_new(), nullptr };
+
+    if (timeout > 0) {
+        auto timer = g_timeout_source_new(timeout);
+        g_source_set_callback(timer, onCloseTimeoutWrapper, request, nullptr);
+        g_source_attach(timer, m_mainContext->handle());
+        g_source_unref(timer);
+        request->timer = timer;
+    }
+
+    m_closeRequest = request;
+    frida_device_manager_close(m_handle, request->cancellable, onCloseReadyWrapper, request);
+}
+
+void Frida::onCloseReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    auto request = static_cast<CloseManagerRequest *>(data);
+
+    frida_device_manager_close_finish(FRIDA_DEVICE_MANAGER(obj), res, nullptr);
+    if (request->frida != nullptr)
+        request->frida->finishClose(request);
+
+    g_object_unref(request->cancellable);
+    delete request;
+}
+
+gboolean Frida::onCloseTimeoutWrapper(gpointer data)
+{
+    auto request = static_cast<CloseManagerRequest *>(data);
+
+    request->timer = nullptr;
+    request->frida->finishClose(request);
+
+    return FALSE;
+}
+
+void Frida::finishClose(CloseManagerRequest *request)
+{
+    if (request->timer != nullptr) {
+        g_source_destroy(request->timer);
+        request->timer = nullptr;
+    }
+    g_cancellable_cancel(request->cancellable);
+    request->frida = nullptr;
+    m_closeRequest = nullptr;
+
+    invokeQueued(this, "onManagerClosed");
+}
+
+void Frida::onManagerClosed()
+{
+    m_closed = true;
+    Q_EMIT shutdownFinished(m_shutdownAbandoned);
+}
+
+void Frida::onRemoteDeviceReady(QString address, QString id)
+{
+    if (!m_remoteDeviceIds.contains(address))
+        return;
+    m_remoteDeviceIds[address] = id;
+
+    for (Device *device : std::as_const(m_deviceItems)) {
+        if (device->id() == id) {
+            Q_EMIT remoteDeviceAdded(address, device);
+            return;
+        }
+    }
+}
+
+void Frida::onRemoteDeviceError(QString address, QString message)
+{
+    if (m_remoteDeviceIds.value(address).isEmpty())
+        m_remoteDeviceIds.remove(address);
+
+    Q_EMIT remoteDeviceError(address, message);
 }
 
 void Frida::add(Device *device)
 {
+    if (m_devicesById.contains(device->id())) {
+        delete device;
+        return;
+    }
+
     device->setParent(this);
     m_deviceItems.append(device);
+    m_devicesById[device->id()] = device;
     Q_EMIT deviceAdded(device);
+
+    for (auto it = m_remoteDeviceIds.constBegin(); it != m_remoteDeviceIds.constEnd(); ++it) {
+        if (it.value() == device->id()) {
+            Q_EMIT remoteDeviceAdded(it.key(), device);
+            break;
+        }
+    }
+
+    m_pendingAdded.append(device);
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        invokeQueued(this, "flushDeviceChanges");
+    }
 }
 
 void Frida::removeById(QString id)
 {
-    for (int i = 0; i != m_deviceItems.size(); i++) {
-        auto device = m_deviceItems.at(i);
-        if (device->id() == id) {
-            m_deviceItems.removeAt(i);
-            Q_EMIT deviceRemoved(device);
-            delete device;
-            break;
-        }
+    auto device = m_devicesById.take(id);
+    if (device == nullptr)
+        return;
+
+    // A remote connection that went away without removeRemoteDevice() being
+    // asked for, so callers learn that the address needs adding again.
+    QStringList lostAddresses;
+    m_remoteDeviceIds.removeIf([&] (const auto &entry) {
+        if (entry.value() != id)
+            return false;
+        lostAddresses.append(entry.key());
+        return true;
+    });
+    m_deviceItems.removeOne(device);
+    Q_EMIT deviceRemoved(device);
+    for (const QString &address : std::as_const(lostAddresses))
+        Q_EMIT remoteDeviceRemoved(address);
+
+    // Listeners of the batched signal still get to see the device, so it
+    // is only deleted once the batch has been delivered. The removal is
+    // reported even if the addition never was, as a model created in
+    // between has picked the device up from deviceItems().
+    m_pendingAdded.removeOne(device);
+    m_pendingRemoved.append(device);
+    m_pendingDeletes.append(device);
+    if (!m_flushScheduled) {
+        m_flushScheduled = true;
+        invokeQueued(this, "flushDeviceChanges");
     }
 }
+
+void Frida::flushDeviceChanges()
+{
+    m_flushScheduled = false;
+
+    QList<Device *> added;
+    added.swap(m_pendingAdded);
+    QList<Device *> removed;
+    removed.swap(m_pendingRemoved);
+    QList<Device *> deletes;
+    deletes.swap(m_pendingDeletes);
+
+    if (!removed.isEmpty())
+        Q_EMIT devicesRemoved(removed);
+    if (!added.isEmpty())
+        Q_EMIT devicesAdded(added);
+
+    for (Device *device : std::as_const(deletes))
+        retire(device);
+}
@@ -3,13 +3,20 @@
 
 #include "fridafwd.h"
 
+#include <QDeadlineTimer>
+#include <QHash>
 #include <QMutex>
 #include <QQmlEngine>
+#include <QSet>
 #include <QWaitCondition>
 
 Q_MOC_INCLUDE("device.h")
+Q_MOC_INCLUDE("stats.h")
+struct AddRemoteDeviceRequest;
+struct CloseManagerRequest;
 class Device;
 class MainContext;
+class Stats;
 class Scripts;
 
 class Frida : public QObject
@@ -17,6 +24,8 @@ class Frida : public QObject
     Q_OBJECT
     Q_DISABLE_COPY_MOVE(Frida)
     Q_PROPERTY(Device *localSystem READ localSystem CONSTANT)
+    Q_PROPERTY(Stats *stats READ stats CONSTANT)
+    Q_PROPERTY(bool tracingAvailable READ isTracingAvailable CONSTANT)
     QML_ELEMENT
     QML_SINGLETON
 
@@ -38,13 +47,31 @@ public:
     static Frida *instance();
 
     Device *localSystem() const { return m_localSystem; }
+    Stats *stats() const { return m_stats; }
 
     QList<Device *> deviceItems() const { return m_deviceItems; }
+    Q_INVOKABLE Device *deviceById(QString id) const { return m_devicesById.value(id); }
+
+    Q_INVOKABLE void addRemoteDevice(QString address, QVariantMap options = QVariantMap());
+    Q_INVOKABLE void removeRemoteDevice(QString address);
+
+    Q_INVOKABLE void shutdown(int maxPending = 16, int timeout = 5000);
+
+    bool isTracingAvailable() const;
+    Q_INVOKABLE bool exportTrace(QString path);
+    Q_INVOKABLE void clearTrace();
 
 Q_SIGNALS:
     void localSystemChanged(Device *newLocalSystem);
     void deviceAdded(Device *device);
     void deviceRemoved(Device *device);
+    void devicesAdded(QList<Device *> devices);
+    void devicesRemoved(QList<Device *> devices);
+    void remoteDeviceAdded(QString address, Device *device);
+    void remoteDeviceError(QString address, QString message);
+    void remoteDeviceRemoved(QString address);
+    void shutdownProgress(int completed, int total);
+    void shutdownFinished(int abandoned);
 
 private:
     static void onGetLocalDeviceReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
@@ -55,16 +82,48 @@ private:
     static void onDeviceRemovedWrapper(Frida *self, FridaDevice *deviceHandle);
     void onDeviceAdded(FridaDevice *deviceHandle);
     void onDeviceRemoved(FridaDevice *deviceHandle);
+    void performAddRemoteDevice(QString address, QVariantMap options);
+    static void onAddRemoteDeviceReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onAddRemoteDeviceReady(AddRemoteDeviceRequest *request, GAsyncResult *res);
+    void performRemoveRemoteDevice(QString address);
+    void retire(Device *device);
+    void awaitShutdown(Device *device, int maxPending, int timeout);
+    void onDeviceShutDown(Device *device);
+    void performClose(int timeout);
+    static void onCloseReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    static gboolean onCloseTimeoutWrapper(gpointer data);
+    void finishClose(CloseManagerRequest *request);
 
 private Q_SLOTS:
     void add(Device *device);
     void removeById(QString id);
+    void onRemoteDeviceReady(QString address, QString id);
+    void onRemoteDeviceError(QString address, QString message);
+    void flushDeviceChanges();
+    void onManagerClosed();
 
 private:
     QMutex m_mutex;
     FridaDeviceManager *m_handle;
     QList<Device *> m_deviceItems;
+    QHash<QString, Device *> m_devicesById;
+    QList<Device *> m_pendingAdded;
+    QList<Device *> m_pendingRemoved;
+    QList<Device *> m_pendingDeletes;
+    QSet<Device *> m_retiringDevices;
+    bool m_flushScheduled;
+    QSet<QString> m_knownDeviceIds;
+    QHash<QString, QString> m_remoteDeviceIds;
+    QHash<QString, AddRemoteDeviceRequest *> m_addRemoteDeviceRequests;
     Device *m_localSystem;
+    Stats *m_stats;
+    bool m_shuttingDown;
+    bool m_closed;
+    QSet<Device *> m_shutdownDevices;
+    QHash<Device *, QPair<int, int>> m_shutdownProgress;
+    int m_shutdownAbandoned;
+    QDeadlineTimer m_shutdownDeadline;
+    CloseManagerRequest *m_closeRequest;
     QWaitCondition m_localSystemAvailable;
     QScopedPointer<MainContext> m_mainContext;
 
@@ -6,23 +6,34 @@
 extern "C"
 {
     typedef struct _FridaApplication FridaApplication;
+    typedef struct _FridaChild FridaChild;
     typedef struct _FridaCrash FridaCrash;
     typedef struct _FridaDevice FridaDevice;
     typedef struct _FridaDeviceManager FridaDeviceManager;
     typedef struct _FridaIcon FridaIcon;
     typedef struct _FridaProcess FridaProcess;
     typedef struct _FridaScript FridaScript;
+    typedef struct _FridaScriptOptions FridaScriptOptions;
     typedef struct _FridaSession FridaSession;
+    typedef struct _FridaSpawn FridaSpawn;
     typedef struct _FridaSpawnOptions FridaSpawnOptions;
 
     typedef struct _GAsyncResult GAsyncResult;
     typedef struct _GBytes GBytes;
+    typedef struct _GCancellable GCancellable;
     typedef struct _GError GError;
     typedef struct _GObject GObject;
     typedef struct _GSource GSource;
 
     typedef void *gpointer;
     typedef int gint;
+    typedef unsigned int guint;
+    typedef unsigned long gulong;
+#if defined(_WIN32) || !defined(__LP64__)
+    typedef signed long long gint64;
+#else
+    typedef signed long gint64;
+#endif
     typedef gint gboolean;
     typedef char gchar;
 }
@@ -0,0 +1,269 @@
+#include "logsink.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QMutexLocker>
+
+static const int LogMessageTimestampRole = Qt::UserRole + 0;
+static const int LogMessagePidRole = Qt::UserRole + 1;
+static const int LogMessageLevelRole = Qt::UserRole + 2;
+static const int LogMessagePayloadRole = Qt::UserRole + 3;
+
+static const qint64 LogFileChunkSize = 1024 * 1024;
+
+LogSink::LogSink(QObject *parent) :
+    QObject(parent),
+    m_level(Level::Debug),
+    m_capacity(10000),
+    m_logMessages(new LogMessageListModel(this)),
+    m_buffer(std::make_shared<LogBuffer>(this))
+{
+}
+
+LogSink::~LogSink()
+{
+    m_buffer->detach();
+}
+
+void LogSink::setLevel(Level level)
+{
+    if (level == m_level)
+        return;
+
+    m_level = level;
+    m_buffer->setLevel(level);
+    Q_EMIT levelChanged(m_level);
+}
+
+void LogSink::setCapacity(int capacity)
+{
+    if (capacity == m_capacity || capacity < 1)
+        return;
+
+    m_capacity = capacity;
+    m_buffer->setCapacity(capacity);
+    m_logMessages->m_entries.trim(capacity);
+    Q_EMIT capacityChanged(m_capacity);
+}
+
+void LogSink::setFilePath(QString filePath)
+{
+    if (filePath == m_filePath)
+        return;
+
+    m_filePath = filePath;
+
+    std::unique_ptr<LogFileWriter> writer;
+    if (!filePath.isEmpty()) {
+        writer.reset(new LogFileWriter(filePath));
+
+        QString errorMessage;
+        if (!writer->open(&errorMessage)) {
+            writer.reset();
+            Q_EMIT error(errorMessage);
+        }
+    }
+    m_buffer->setWriter(std::move(writer));
+
+    Q_EMIT filePathChanged(m_filePath);
+}
+
+void LogSink::clear()
+{
+    m_buffer->m_pending.take();
+    m_logMessages->m_entries.trim(0);
+}
+
+bool LogSink::parseLevel(const QByteArray &message, Level *level)
+{
+    // Fast path for the layout emitted by the agent runtime, so entries that
+    // are about to be filtered out never get parsed.
+    static const QByteArray prefix("{\"type\":\"log\",\"level\":\"");
+    if (!message.startsWith(prefix))
+        return false;
+
+    const char *name = message.constData() + prefix.size();
+    if (qstrncmp(name, "debug\"", 6) == 0)
+        *level = Level::Debug;
+    else if (qstrncmp(name, "info\"", 5) == 0)
+        *level = Level::Info;
+    else if (qstrncmp(name, "warning\"", 8) == 0)
+        *level = Level::Warning;
+    else if (qstrncmp(name, "error\"", 6) == 0)
+        *level = Level::Error;
+    else
+        return false;
+
+    return true;
+}
+
+LogSink::Level LogSink::parseLevelName(const QString &name)
+{
+    if (name == "debug")
+        return Level::Debug;
+    if (name == "warning")
+        return Level::Warning;
+    if (name == "error")
+        return Level::Error;
+    return Level::Info;
+}
+
+void LogSink::drain()
+{
+    m_logMessages->m_entries.append(m_buffer->m_pending.take(), m_capacity);
+}
+
+LogMessageListModel::LogMessageListModel(LogSink *parent) :
+    QAbstractListModel(parent),
+    m_entries(this)
+{
+}
+
+QHash<int, QByteArray> LogMessageListModel::roleNames() const
+{
+    QHash<int, QByteArray> r;
+    r[Qt::DisplayRole] = "display";
+    r[LogMessageTimestampRole] = "timestamp";
+    r[LogMessagePidRole] = "pid";
+    r[LogMessageLevelRole] = "level";
+    r[LogMessagePayloadRole] = "payload";
+    return r;
+}
+
+int LogMessageListModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+
+    return m_entries.size();
+}
+
+QVariant LogMessageListModel::data(const QModelIndex &index, int role) const
+{
+    const LogEntry &entry = m_entries.at(index.row());
+    switch (role) {
+    case LogMessageTimestampRole:
+        return QVariant(QDateTime::fromMSecsSinceEpoch(entry.timestamp));
+    case LogMessagePidRole:
+        return QVariant(entry.pid);
+    case LogMessageLevelRole:
+        return QVariant::fromValue(entry.level);
+    case Qt::DisplayRole:
+    case LogMessagePayloadRole:
+        return QVariant(QJsonDocument::fromJson(entry.message).object()["payload"].toString());
+    default:
+        return QVariant();
+    }
+}
+
+LogFileWriter::LogFileWriter(QString path) :
+    m_file(path),
+    m_map(nullptr),
+    m_mapOffset(0),
+    m_mapSize(0),
+    m_size(0)
+{
+}
+
+LogFileWriter::~LogFileWriter()
+{
+    if (!m_file.isOpen())
+        return;
+
+    if (m_map != nullptr)
+        m_file.unmap(m_map);
+    m_file.resize(m_size);
+    m_file.close();
+}
+
+bool LogFileWriter::open(QString *errorMessage)
+{
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        *errorMessage = QString("Failed to open “").append(m_file.fileName()).append("”: ")
+            .append(m_file.errorString());
+        return false;
+    }
+
+    m_size = m_file.size();
+
+    return true;
+}
+
+void LogFileWriter::write(const LogEntry &entry)
+{
+    QByteArray line;
+    line.reserve(entry.message.size() + 64);
+    line.append("{\"timestamp\":").append(QByteArray::number(entry.timestamp))
+        .append(",\"pid\":").append(QByteArray::number(entry.pid))
+        .append(",\"message\":").append(entry.message)
+        .append("}\n");
+
+    if (!reserve(line.size()))
+        return;
+
+    memcpy(m_map + (m_size - m_mapOffset), line.constData(), line.size());
+    m_size += line.size();
+}
+
+bool LogFileWriter::reserve(qint64 size)
+{
+    if (m_map != nullptr && m_size + size <= m_mapOffset + m_mapSize)
+        return true;
+
+    if (m_map != nullptr) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+
+    m_mapOffset = m_size;
+    m_mapSize = qMax(LogFileChunkSize, size);
+    if (!m_file.resize(m_mapOffset + m_mapSize))
+        return false;
+
+    m_map = m_file.map(m_mapOffset, m_mapSize);
+
+    return m_map != nullptr;
+}
+
+LogBuffer::LogBuffer(LogSink *owner) :
+    m_level(static_cast<int>(owner->level())),
+    m_pending(owner, "drain", owner->capacity())
+{
+}
+
+void LogBuffer::append(int pid, LogSink::Level level, const QByteArray &message)
+{
+    LogEntry entry { QDateTime::currentMSecsSinceEpoch(), pid, level, QByteArray(message.constData(), message.size()) };
+
+    {
+        QMutexLocker locker(&m_writerMutex);
+        if (m_writer != nullptr)
+            m_writer->write(entry);
+    }
+
+    m_pending.append(std::move(entry));
+}
+
+void LogBuffer::detach()
+{
+    m_pending.detach();
+
+    QMutexLocker locker(&m_writerMutex);
+    m_writer.reset();
+}
+
+void LogBuffer::setLevel(LogSink::Level level)
+{
+    m_level.storeRelaxed(static_cast<int>(level));
+}
+
+void LogBuffer::setCapacity(int capacity)
+{
+    m_pending.setCapacity(capacity);
+}
+
+void LogBuffer::setWriter(std::unique_ptr<LogFileWriter> writer)
+{
+    QMutexLocker locker(&m_writerMutex);
+    m_writer = std::move(writer);
+}
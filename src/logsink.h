@@ -0,0 +1,143 @@
+#ifndef FRIDAQML_LOGSINK_H
+#define FRIDAQML_LOGSINK_H
+
+#include "cappedlog.h"
+
+#include <memory>
+#include <QAbstractListModel>
+#include <QAtomicInt>
+#include <QFile>
+#include <QMutex>
+#include <QQmlEngine>
+
+class LogBuffer;
+class LogMessageListModel;
+
+class LogSink : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(LogSink)
+    Q_PROPERTY(Level level READ level WRITE setLevel NOTIFY levelChanged)
+    Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+    Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
+    Q_PROPERTY(LogMessageListModel *logMessages READ logMessages CONSTANT FINAL)
+    QML_ELEMENT
+
+public:
+    enum class Level { Debug, Info, Warning, Error };
+    Q_ENUM(Level)
+
+    explicit LogSink(QObject *parent = nullptr);
+    ~LogSink();
+
+    Level level() const { return m_level; }
+    void setLevel(Level level);
+    int capacity() const { return m_capacity; }
+    void setCapacity(int capacity);
+    QString filePath() const { return m_filePath; }
+    void setFilePath(QString filePath);
+    LogMessageListModel *logMessages() const { return m_logMessages; }
+
+    Q_INVOKABLE void clear();
+
+    std::shared_ptr<LogBuffer> buffer() const { return m_buffer; }
+
+    static bool parseLevel(const QByteArray &message, Level *level);
+    static Level parseLevelName(const QString &name);
+
+Q_SIGNALS:
+    void levelChanged(Level newLevel);
+    void capacityChanged(int newCapacity);
+    void filePathChanged(QString newFilePath);
+    void error(QString message);
+
+private Q_SLOTS:
+    void drain();
+
+private:
+    Level m_level;
+    int m_capacity;
+    QString m_filePath;
+    LogMessageListModel *m_logMessages;
+    std::shared_ptr<LogBuffer> m_buffer;
+
+    friend class LogBuffer;
+};
+
+struct LogEntry
+{
+    qint64 timestamp;
+    int pid;
+    LogSink::Level level;
+    QByteArray message;
+};
+
+class LogMessageListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(LogMessageListModel)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    QML_ELEMENT
+    QML_UNCREATABLE("LogMessageListModel objects cannot be instantiated from Qml");
+
+public:
+    explicit LogMessageListModel(LogSink *parent);
+
+    int count() const { return m_entries.size(); }
+
+    QHash<int, QByteArray> roleNames() const override;
+    int rowCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+
+Q_SIGNALS:
+    void countChanged(int newCount);
+
+private:
+    CappedRows<LogMessageListModel, LogEntry> m_entries;
+
+    friend class LogSink;
+    friend class CappedRows<LogMessageListModel, LogEntry>;
+};
+
+class LogFileWriter
+{
+public:
+    explicit LogFileWriter(QString path);
+    ~LogFileWriter();
+
+    bool open(QString *errorMessage);
+    void write(const LogEntry &entry);
+
+private:
+    bool reserve(qint64 size);
+
+    QFile m_file;
+    uchar *m_map;
+    qint64 m_mapOffset;
+    qint64 m_mapSize;
+    qint64 m_size;
+};
+
+class LogBuffer
+{
+public:
+    explicit LogBuffer(LogSink *owner);
+
+    bool accepts(LogSink::Level level) const { return static_cast<int>(level) >= m_level.loadRelaxed(); }
+    void append(int pid, LogSink::Level level, const QByteArray &message);
+
+private:
+    void detach();
+    void setLevel(LogSink::Level level);
+    void setCapacity(int capacity);
+    void setWriter(std::unique_ptr<LogFileWriter> writer);
+
+    QAtomicInt m_level;
+    PendingEntries<LogEntry> m_pending;
+    QMutex m_writerMutex;
+    std::unique_ptr<LogFileWriter> m_writer;
+
+    friend class LogSink;
+};
+
+#endif
@@ -1,7 +1,12 @@
 #include "maincontext.h"
 
+#include "stats.h"
+#include "tracing.h"
+
 MainContext::MainContext(GMainContext *mainContext) :
-    m_handle(mainContext)
+    m_handle(mainContext),
+    m_loop(nullptr),
+    m_thread(nullptr)
 {
     g_mutex_init(&m_mutex);
     g_cond_init(&m_cond);
@@ -9,35 +14,58 @@ MainContext::MainContext(GMainContext *mainContext) :
 
 MainContext::~MainContext()
 {
+    if (m_thread != nullptr) {
+        auto loop = m_loop;
+        schedule([loop] () { g_main_loop_quit(loop); });
+        g_thread_join(m_thread);
+        g_main_loop_unref(m_loop);
+        g_main_context_unref(m_handle);
+    }
+
     g_cond_clear(&m_cond);
     g_mutex_clear(&m_mutex);
 }
 
+MainContext *MainContext::createWorker(const char *name)
+{
+    auto context = new MainContext(g_main_context_new());
+    context->m_loop = g_main_loop_new(context->handle(), FALSE);
+    context->m_thread = g_thread_new(name, runWorker, context);
+    return context;
+}
+
+gpointer MainContext::runWorker(gpointer data)
+{
+    auto self = static_cast<MainContext *>(data);
+
+    // Sources created without an explicit context end up here. Workers only
+    // run our own code, as frida objects belong to frida's main context.
+    g_main_context_push_thread_default(self->m_handle);
+    g_main_loop_run(self->m_loop);
+    g_main_context_pop_thread_default(self->m_handle);
+
+    return nullptr;
+}
+
 void MainContext::schedule(std::function<void ()> f)
 {
-    auto source = g_idle_source_new();
-    g_source_set_callback(source, performCallback, new std::function<void ()>(f), destroyCallback);
-    g_source_attach(source, m_handle);
-    g_source_unref(source);
+    attach(new ScheduledCall { f, HopStats::fridaQueue()->enter(), false });
 }
 
 void MainContext::perform(std::function<void ()> f)
 {
     volatile bool finished = false;
+    FRIDAQML_TRACE_SCOPE("MainContext.perform");
 
-    auto work = new std::function<void ()>([this, f, &finished] () {
+    auto work = [this, f, &finished] () {
         f();
 
         g_mutex_lock(&m_mutex);
         finished = true;
         g_cond_signal(&m_cond);
         g_mutex_unlock(&m_mutex);
-    });
-
-    auto source = g_idle_source_new();
-    g_source_set_callback(source, performCallback, work, destroyCallback);
-    g_source_attach(source, m_handle);
-    g_source_unref(source);
+    };
+    attach(new ScheduledCall { work, HopStats::fridaQueue()->enter(), false });
 
     g_mutex_lock(&m_mutex);
     while (!finished)
@@ -45,15 +73,32 @@ void MainContext::perform(std::function<void ()> f)
     g_mutex_unlock(&m_mutex);
 }
 
+void MainContext::attach(ScheduledCall *call)
+{
+    auto source = g_idle_source_new();
+    g_source_set_callback(source, performCallback, call, destroyCallback);
+    g_source_attach(source, m_handle);
+    g_source_unref(source);
+}
+
 gboolean MainContext::performCallback(gpointer data)
 {
-    auto f = static_cast<std::function<void ()> *>(data);
-    (*f)();
+    auto call = static_cast<ScheduledCall *>(data);
+
+    HopStats::fridaQueue()->leave(call->enqueueTime);
+    call->performed = true;
+
+    FRIDAQML_TRACE_SINCE("MainContext.wait", call->enqueueTime);
+    FRIDAQML_TRACE_SCOPE("MainContext.run");
+    call->f();
+
     return FALSE;
 }
 
 void MainContext::destroyCallback(gpointer data)
 {
-    auto f = static_cast<std::function<void ()> *>(data);
-    delete f;
+    auto call = static_cast<ScheduledCall *>(data);
+    if (!call->performed)
+        HopStats::fridaQueue()->cancel();
+    delete call;
 }
@@ -10,18 +10,31 @@ public:
     MainContext(GMainContext *mainContext);
     ~MainContext();
 
+    static MainContext *createWorker(const char *name);
+
     void schedule(std::function<void ()> f);
     void perform(std::function<void ()> f);
 
     GMainContext *handle() const { return m_handle; }
 
 private:
+    struct ScheduledCall
+    {
+        std::function<void ()> f;
+        gint64 enqueueTime;
+        bool performed;
+    };
+
+    void attach(ScheduledCall *call);
     static gboolean performCallback(gpointer data);
     static void destroyCallback(gpointer data);
+    static gpointer runWorker(gpointer data);
 
     GMainContext *m_handle;
     GMutex m_mutex;
     GCond m_cond;
+    GMainLoop *m_loop;
+    GThread *m_thread;
 };
 
 #endif
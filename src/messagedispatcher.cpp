@@ -0,0 +1,199 @@
+#include <frida-core.h>
+
+#include "messagedispatcher.h"
+
+#include "logsink.h"
+#include "maincontext.h"
+#include "script.h"
+#include "stats.h"
+#include "tracing.h"
+
+#include <QCborValue>
+#include <QDebug>
+#include <QJsonDocument>
+#include <QMutexLocker>
+#include <QThread>
+
+Q_GLOBAL_STATIC(MessageDispatcher, dispatcher)
+
+// What the agent's send('$cbor', bytes) turns into; the payload is in the bytes.
+static const char CborMessage[] = "{\"type\":\"send\",\"payload\":\"$cbor\"}";
+
+MessageDispatcher::MessageDispatcher()
+{
+    m_pool.setMaxThreadCount(qBound(1, QThread::idealThreadCount() / 2, 4));
+}
+
+MessageDispatcher::~MessageDispatcher()
+{
+    m_pool.waitForDone();
+}
+
+MessageDispatcher *MessageDispatcher::instance()
+{
+    return dispatcher();
+}
+
+void MessageDispatcher::deliver(const MessageRoute &route, const QByteArray &message, GBytes *data)
+{
+    FRIDAQML_TRACE_SCOPE("MessageDispatcher.deliver");
+
+    if (route.cborPayloads && data != nullptr && message == CborMessage) {
+        for (const auto &tap : route.taps)
+            tap->onMessage(route.pid, message, data);
+        deliverCbor(route, data);
+        return;
+    }
+
+    auto logBuffer = route.logBuffer.get();
+
+    LogSink::Level level;
+    if (logBuffer != nullptr && LogSink::parseLevel(message, &level)) {
+        if (logBuffer->accepts(level))
+            logBuffer->append(route.pid, level, message);
+        return;
+    }
+
+    auto messageDocument = QJsonDocument::fromJson(message);
+    auto messageObject = messageDocument.object();
+
+    if (messageObject["type"] == "log") {
+        if (logBuffer != nullptr) {
+            level = LogSink::parseLevelName(messageObject["level"].toString());
+            if (logBuffer->accepts(level))
+                logBuffer->append(route.pid, level, message);
+            return;
+        }
+
+        std::string logMessage = messageObject["payload"].toString().toStdString();
+        qDebug("%s", logMessage.c_str());
+    } else {
+        for (const auto &tap : route.taps)
+            tap->onMessage(route.pid, message, data);
+
+        QVariant dataValue;
+        if (data != nullptr) {
+            gsize dataSize;
+            auto dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
+            dataValue = QByteArray(dataBuffer, dataSize);
+        }
+
+        invokeQueued(route.wrapper, "onMessage",
+            Q_ARG(QJsonObject, messageObject),
+            Q_ARG(QVariant, dataValue));
+    }
+}
+
+void MessageDispatcher::deliverCbor(const MessageRoute &route, GBytes *data)
+{
+    gsize dataSize;
+    auto dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
+
+    QCborParserError error;
+    auto payload = QCborValue::fromCbor(QByteArray::fromRawData(dataBuffer, dataSize), &error);
+
+    // The decoded payload travels as the data, which unlike JSON keeps 64-bit
+    // integers and byte strings intact.
+    QJsonObject messageObject;
+    QVariant dataValue;
+    if (error.error == QCborError::NoError) {
+        messageObject["type"] = "send";
+        messageObject["payload"] = "$cbor";
+        dataValue = payload.toVariant();
+    } else {
+        messageObject["type"] = "error";
+        messageObject["description"] = "Malformed CBOR payload: " + error.errorString();
+    }
+
+    invokeQueued(route.wrapper, "onMessage",
+        Q_ARG(QJsonObject, messageObject),
+        Q_ARG(QVariant, dataValue));
+}
+
+MessageQueue::MessageQueue(MainContext *context) :
+    m_context(context),
+    m_scheduled(false),
+    m_delivering(false),
+    m_closed(false)
+{
+}
+
+MessageQueue::~MessageQueue()
+{
+    release(m_pending);
+}
+
+void MessageQueue::release(QQueue<PendingMessage> &pending)
+{
+    for (const PendingMessage &message : std::as_const(pending)) {
+        if (message.data != nullptr)
+            g_bytes_unref(message.data);
+    }
+    pending.clear();
+}
+
+void MessageQueue::push(const MessageRoute &route, const gchar *message, GBytes *data)
+{
+    PendingMessage pending { route, QByteArray(message), (data != nullptr) ? g_bytes_ref(data) : nullptr };
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_closed) {
+            locker.unlock();
+            if (pending.data != nullptr)
+                g_bytes_unref(pending.data);
+            return;
+        }
+
+        m_pending.enqueue(pending);
+        if (m_scheduled)
+            return;
+        m_scheduled = true;
+    }
+
+    // A single drain task per queue at any time keeps per-instance ordering.
+    auto self = shared_from_this();
+    if (m_context != nullptr)
+        m_context->schedule([self] () { self->drain(); });
+    else
+        MessageDispatcher::instance()->pool()->start([self] () { self->drain(); });
+}
+
+void MessageQueue::close()
+{
+    QQueue<PendingMessage> pending;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        pending.swap(m_pending);
+
+        // The wrapper may be gone as soon as we return, so a delivery that
+        // is already underway has to finish first.
+        while (m_delivering)
+            m_idle.wait(&m_mutex);
+    }
+
+    release(pending);
+}
+
+void MessageQueue::drain()
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_closed && !m_pending.isEmpty()) {
+        auto pending = m_pending.dequeue();
+        m_delivering = true;
+        locker.unlock();
+
+        MessageDispatcher::deliver(pending.route, pending.message, pending.data);
+
+        if (pending.data != nullptr)
+            g_bytes_unref(pending.data);
+
+        locker.relock();
+        m_delivering = false;
+        m_idle.wakeAll();
+    }
+
+    m_scheduled = false;
+}
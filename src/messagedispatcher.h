@@ -0,0 +1,85 @@
+#ifndef FRIDAQML_MESSAGEDISPATCHER_H
+#define FRIDAQML_MESSAGEDISPATCHER_H
+
+#include "fridafwd.h"
+
+#include <memory>
+#include <QByteArray>
+#include <QList>
+#include <QMutex>
+#include <QQueue>
+#include <QThreadPool>
+#include <QWaitCondition>
+
+class LogBuffer;
+class MainContext;
+class ScriptInstance;
+
+class MessageTap
+{
+public:
+    virtual ~MessageTap() = default;
+
+    virtual void onMessage(int pid, const QByteArray &message, GBytes *data) = 0;
+};
+
+typedef QList<std::shared_ptr<MessageTap>> MessageTapList;
+
+struct MessageRoute
+{
+    ScriptInstance *wrapper = nullptr;
+    int pid = -1;
+    std::shared_ptr<LogBuffer> logBuffer;
+    MessageTapList taps;
+    bool cborPayloads = false;
+};
+
+class MessageDispatcher
+{
+public:
+    explicit MessageDispatcher();
+    ~MessageDispatcher();
+
+    static MessageDispatcher *instance();
+
+    QThreadPool *pool() { return &m_pool; }
+
+    static void deliver(const MessageRoute &route, const QByteArray &message, GBytes *data);
+
+private:
+    static void deliverCbor(const MessageRoute &route, GBytes *data);
+
+    QThreadPool m_pool;
+};
+
+class MessageQueue : public std::enable_shared_from_this<MessageQueue>
+{
+public:
+    explicit MessageQueue(MainContext *context = nullptr);
+    ~MessageQueue();
+
+    void push(const MessageRoute &route, const gchar *message, GBytes *data);
+    void close();
+
+private:
+    struct PendingMessage
+    {
+        MessageRoute route;
+        QByteArray message;
+        GBytes *data = nullptr;
+    };
+
+    void drain();
+
+    static void release(QQueue<PendingMessage> &pending);
+
+    MainContext *m_context;
+    QMutex m_mutex;
+    QWaitCondition m_idle;
+    QQueue<PendingMessage> m_pending;
+    bool m_scheduled;
+    bool m_delivering;
+    bool m_closed;
+};
+
+#endif
@@ -0,0 +1,177 @@
+#include <frida-core.h>
+
+#include "messagelogmodel.h"
+
+#include "script.h"
+#include "tracing.h"
+
+#include <QDateTime>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+static const int MessageTimestampRole = Qt::UserRole + 0;
+static const int MessagePidRole = Qt::UserRole + 1;
+static const int MessageTypeRole = Qt::UserRole + 2;
+static const int MessagePayloadRole = Qt::UserRole + 3;
+static const int MessageDataRole = Qt::UserRole + 4;
+static const int MessageJsonRole = Qt::UserRole + 5;
+
+static const int FlushInterval = 16;
+
+MessageLogModel::MessageLogModel(QObject *parent) :
+    QAbstractListModel(parent),
+    m_entries(this),
+    m_capacity(10000)
+{
+    m_buffer = std::make_shared<MessageLogBuffer>(this, m_capacity);
+
+    m_flushTimer.setSingleShot(true);
+    m_flushTimer.setInterval(FlushInterval);
+    connect(&m_flushTimer, &QTimer::timeout, this, &MessageLogModel::flush);
+}
+
+MessageLogModel::~MessageLogModel()
+{
+    detach();
+    m_buffer->m_pending.detach();
+}
+
+void MessageLogModel::setCapacity(int capacity)
+{
+    if (capacity == m_capacity || capacity < 1)
+        return;
+
+    m_capacity = capacity;
+    m_buffer->m_pending.setCapacity(capacity);
+    m_entries.trim(capacity);
+    Q_EMIT capacityChanged(m_capacity);
+}
+
+void MessageLogModel::setScript(Script *script)
+{
+    if (script == m_script)
+        return;
+
+    detach();
+
+    m_script = script;
+    if (script != nullptr)
+        script->addMessageTap(m_buffer);
+    Q_EMIT scriptChanged(script);
+}
+
+void MessageLogModel::setInstance(ScriptInstance *instance)
+{
+    if (instance == m_instance)
+        return;
+
+    detach();
+
+    m_instance = instance;
+    if (instance != nullptr)
+        instance->addMessageTap(m_buffer);
+    Q_EMIT instanceChanged(instance);
+}
+
+QVariantMap MessageLogModel::get(int index) const
+{
+    if (index < 0 || index >= m_entries.size())
+        return QVariantMap();
+
+    QVariantMap result = QJsonDocument::fromJson(m_entries.at(index).message).object().toVariantMap();
+    auto modelIndex = this->index(index);
+    result["timestamp"] = data(modelIndex, MessageTimestampRole);
+    result["pid"] = data(modelIndex, MessagePidRole);
+    result["data"] = data(modelIndex, MessageDataRole);
+    return result;
+}
+
+void MessageLogModel::clear()
+{
+    m_buffer->m_pending.take();
+    m_entries.trim(0);
+}
+
+QHash<int, QByteArray> MessageLogModel::roleNames() const
+{
+    QHash<int, QByteArray> r;
+    r[Qt::DisplayRole] = "display";
+    r[MessageTimestampRole] = "timestamp";
+    r[MessagePidRole] = "pid";
+    r[MessageTypeRole] = "type";
+    r[MessagePayloadRole] = "payload";
+    r[MessageDataRole] = "data";
+    r[MessageJsonRole] = "json";
+    return r;
+}
+
+int MessageLogModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+
+    return m_entries.size();
+}
+
+QVariant MessageLogModel::data(const QModelIndex &index, int role) const
+{
+    const MessageLogEntry &entry = m_entries.at(index.row());
+    switch (role) {
+    case MessageTimestampRole:
+        return QVariant(QDateTime::fromMSecsSinceEpoch(entry.timestamp));
+    case MessagePidRole:
+        return QVariant(entry.pid);
+    case MessageTypeRole:
+        return QJsonDocument::fromJson(entry.message).object()["type"].toVariant();
+    case MessagePayloadRole:
+        return QJsonDocument::fromJson(entry.message).object()["payload"].toVariant();
+    case MessageDataRole:
+        return entry.hasData ? QVariant(entry.data) : QVariant();
+    case Qt::DisplayRole:
+    case MessageJsonRole:
+        return QVariant(QString::fromUtf8(entry.message));
+    default:
+        return QVariant();
+    }
+}
+
+void MessageLogModel::scheduleFlush()
+{
+    if (!m_flushTimer.isActive())
+        m_flushTimer.start();
+}
+
+void MessageLogModel::flush()
+{
+    FRIDAQML_TRACE_SCOPE("MessageLogModel.flush");
+
+    m_entries.append(m_buffer->m_pending.take(), m_capacity);
+}
+
+void MessageLogModel::detach()
+{
+    if (!m_script.isNull())
+        m_script->removeMessageTap(m_buffer);
+    m_script = nullptr;
+
+    if (!m_instance.isNull())
+        m_instance->removeMessageTap(m_buffer);
+    m_instance = nullptr;
+}
+
+MessageLogBuffer::MessageLogBuffer(MessageLogModel *owner, int capacity) :
+    m_pending(owner, "scheduleFlush", capacity)
+{
+}
+
+void MessageLogBuffer::onMessage(int pid, const QByteArray &message, GBytes *data)
+{
+    MessageLogEntry entry { QDateTime::currentMSecsSinceEpoch(), pid,
+        QByteArray(message.constData(), message.size()), QByteArray(), data != nullptr };
+    if (data != nullptr) {
+        gsize dataSize;
+        auto dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
+        entry.data = QByteArray(dataBuffer, dataSize);
+    }
+
+    m_pending.append(std::move(entry));
+}
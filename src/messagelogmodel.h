@@ -0,0 +1,91 @@
+#ifndef FRIDAQML_MESSAGELOGMODEL_H
+#define FRIDAQML_MESSAGELOGMODEL_H
+
+#include "cappedlog.h"
+#include "messagedispatcher.h"
+
+#include <QAbstractListModel>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QTimer>
+
+Q_MOC_INCLUDE("script.h")
+class MessageLogBuffer;
+class Script;
+class ScriptInstance;
+
+struct MessageLogEntry
+{
+    qint64 timestamp;
+    int pid;
+    QByteArray message;
+    QByteArray data;
+    bool hasData;
+};
+
+class MessageLogModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(MessageLogModel)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(int capacity READ capacity WRITE setCapacity NOTIFY capacityChanged)
+    Q_PROPERTY(Script *script READ script WRITE setScript NOTIFY scriptChanged)
+    Q_PROPERTY(ScriptInstance *instance READ instance WRITE setInstance NOTIFY instanceChanged)
+    QML_ELEMENT
+
+public:
+    explicit MessageLogModel(QObject *parent = nullptr);
+    ~MessageLogModel();
+
+    int count() const { return m_entries.size(); }
+    int capacity() const { return m_capacity; }
+    void setCapacity(int capacity);
+    Script *script() const { return m_script; }
+    void setScript(Script *script);
+    ScriptInstance *instance() const { return m_instance; }
+    void setInstance(ScriptInstance *instance);
+
+    Q_INVOKABLE QVariantMap get(int index) const;
+    Q_INVOKABLE void clear();
+
+    QHash<int, QByteArray> roleNames() const override;
+    int rowCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+
+Q_SIGNALS:
+    void countChanged(int newCount);
+    void capacityChanged(int newCapacity);
+    void scriptChanged(Script *newScript);
+    void instanceChanged(ScriptInstance *newInstance);
+
+private Q_SLOTS:
+    void scheduleFlush();
+    void flush();
+
+private:
+    void detach();
+
+    CappedRows<MessageLogModel, MessageLogEntry> m_entries;
+    int m_capacity;
+    QPointer<Script> m_script;
+    QPointer<ScriptInstance> m_instance;
+    std::shared_ptr<MessageLogBuffer> m_buffer;
+    QTimer m_flushTimer;
+
+    friend class CappedRows<MessageLogModel, MessageLogEntry>;
+};
+
+class MessageLogBuffer : public MessageTap
+{
+public:
+    explicit MessageLogBuffer(MessageLogModel *owner, int capacity);
+
+    void onMessage(int pid, const QByteArray &message, GBytes *data) override;
+
+private:
+    PendingEntries<MessageLogEntry> m_pending;
+
+    friend class MessageLogModel;
+};
+
+#endif
@@ -0,0 +1,443 @@
+#include <frida-core.h>
+
+#include "messagerecorder.h"
+
+#include "script.h"
+#include "stats.h"
+
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QThreadPool>
+#include <QtEndian>
+
+static const char RecordingMagic[4] = { 'F', 'Q', 'M', 'R' };
+static const quint32 RecordingVersion = 1;
+static const quint32 RecordingFlagCompressed = 1 << 0;
+static const int RecordingHeaderSize = 20;
+static const int RecordingBlockSize = 256 * 1024;
+// Blocks waiting for the writer; past this, new blocks are dropped rather
+// than stalling the thread that delivers messages.
+static const int RecordingMaxPendingBlocks = 16;
+
+template <typename T>
+static void appendValue(QByteArray &buffer, T value)
+{
+    T littleEndianValue = qToLittleEndian(value);
+    buffer.append(reinterpret_cast<const char *>(&littleEndianValue), sizeof(T));
+}
+
+template <typename T>
+static bool takeValue(const QByteArray &buffer, qsizetype *offset, T *value)
+{
+    if (buffer.size() - *offset < static_cast<qsizetype>(sizeof(T)))
+        return false;
+    *value = qFromLittleEndian<T>(buffer.constData() + *offset);
+    *offset += sizeof(T);
+    return true;
+}
+
+MessageRecorder::MessageRecorder(QObject *parent) :
+    QObject(parent),
+    m_compressed(false),
+    m_active(false)
+{
+    // Partial blocks are handed to the writer periodically, so a quiet
+    // recording still reaches the disk.
+    m_flushTimer.setInterval(1000);
+    connect(&m_flushTimer, &QTimer::timeout, this, &MessageRecorder::flush);
+}
+
+MessageRecorder::~MessageRecorder()
+{
+    stop();
+
+    if (m_closingTap != nullptr)
+        m_closingTap->detachRecorder();
+}
+
+void MessageRecorder::setScript(Script *script)
+{
+    if (script == m_script)
+        return;
+
+    detach();
+    m_script = script;
+    attach();
+
+    Q_EMIT scriptChanged(script);
+}
+
+void MessageRecorder::setInstance(ScriptInstance *instance)
+{
+    if (instance == m_instance)
+        return;
+
+    detach();
+    m_instance = instance;
+    attach();
+
+    Q_EMIT instanceChanged(instance);
+}
+
+void MessageRecorder::setFilePath(QString filePath)
+{
+    if (filePath == m_filePath)
+        return;
+
+    m_filePath = filePath;
+    Q_EMIT filePathChanged(filePath);
+
+    if (m_active) {
+        stop();
+        start();
+    }
+}
+
+void MessageRecorder::setCompressed(bool compressed)
+{
+    if (compressed == m_compressed)
+        return;
+
+    m_compressed = compressed;
+    Q_EMIT compressedChanged(compressed);
+
+    if (m_active) {
+        stop();
+        start();
+    }
+}
+
+void MessageRecorder::setActive(bool active)
+{
+    if (active == m_active)
+        return;
+
+    m_active = active;
+    if (active)
+        start();
+    else
+        stop();
+
+    Q_EMIT activeChanged(active);
+}
+
+void MessageRecorder::flush()
+{
+    if (m_tap != nullptr)
+        m_tap->flush();
+}
+
+void MessageRecorder::onTapError(QString message)
+{
+    Q_EMIT error(message);
+}
+
+void MessageRecorder::onTapClosed()
+{
+    m_closingTap.reset();
+    Q_EMIT closed();
+
+    if (m_active && m_tap == nullptr)
+        start();
+}
+
+void MessageRecorder::start()
+{
+    // The previous recording may still be writing to the same file, so
+    // onTapClosed() starts this one once it is done.
+    if (m_filePath.isEmpty() || m_closingTap != nullptr)
+        return;
+
+    auto tap = std::make_shared<MessageRecorderTap>(this, m_filePath, m_compressed);
+
+    QString errorMessage;
+    if (!tap->open(&errorMessage)) {
+        Q_EMIT error(errorMessage);
+        return;
+    }
+
+    m_tap = tap;
+    attach();
+    m_flushTimer.start();
+}
+
+void MessageRecorder::stop()
+{
+    if (m_tap == nullptr)
+        return;
+
+    m_flushTimer.stop();
+    detach();
+    m_closingTap = std::move(m_tap);
+    m_closingTap->close();
+}
+
+void MessageRecorder::attach()
+{
+    if (m_tap == nullptr)
+        return;
+
+    if (!m_script.isNull())
+        m_script->addMessageTap(m_tap);
+    if (!m_instance.isNull())
+        m_instance->addMessageTap(m_tap);
+}
+
+void MessageRecorder::detach()
+{
+    if (m_tap == nullptr)
+        return;
+
+    if (!m_script.isNull())
+        m_script->removeMessageTap(m_tap);
+    if (!m_instance.isNull())
+        m_instance->removeMessageTap(m_tap);
+}
+
+MessageRecorderTap::MessageRecorderTap(MessageRecorder *recorder, QString path, bool compressed) :
+    m_recorder(recorder),
+    m_file(path),
+    m_compressed(compressed),
+    m_startTime(g_get_monotonic_time()),
+    m_closed(false),
+    m_failed(false),
+    m_dropping(false),
+    m_writing(false)
+{
+}
+
+bool MessageRecorderTap::open(QString *errorMessage)
+{
+    if (!m_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+        *errorMessage = QString("Failed to open “").append(m_file.fileName()).append("”: ")
+            .append(m_file.errorString());
+        return false;
+    }
+
+    QByteArray header(RecordingMagic, sizeof(RecordingMagic));
+    appendValue<quint32>(header, RecordingVersion);
+    appendValue<quint32>(header, m_compressed ? RecordingFlagCompressed : 0);
+    appendValue<qint64>(header, QDateTime::currentMSecsSinceEpoch());
+    if (m_file.write(header) != header.size()) {
+        *errorMessage = QString("Failed to write “").append(m_file.fileName()).append("”: ")
+            .append(m_file.errorString());
+        m_file.close();
+        return false;
+    }
+
+    m_block.reserve(RecordingBlockSize);
+
+    return true;
+}
+
+void MessageRecorderTap::onMessage(int pid, const QByteArray &message, GBytes *data)
+{
+    auto timestamp = g_get_monotonic_time() - m_startTime;
+
+    const char *dataBuffer = nullptr;
+    gsize dataSize = 0;
+    if (data != nullptr)
+        dataBuffer = static_cast<const char *>(g_bytes_get_data(data, &dataSize));
+
+    QMutexLocker locker(&m_mutex);
+
+    if (m_closed || m_failed)
+        return;
+
+    appendValue<qint64>(m_block, timestamp);
+    appendValue<qint32>(m_block, pid);
+    appendValue<quint32>(m_block, message.size());
+    m_block.append(message);
+    appendValue<qint32>(m_block, (data != nullptr) ? static_cast<qint32>(dataSize) : -1);
+    if (data != nullptr)
+        m_block.append(dataBuffer, dataSize);
+
+    if (m_block.size() >= RecordingBlockSize)
+        submitBlock();
+}
+
+void MessageRecorderTap::flush()
+{
+    QMutexLocker locker(&m_mutex);
+    submitBlock();
+}
+
+void MessageRecorderTap::close()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (m_closed)
+        return;
+    m_closed = true;
+
+    // The writer closes the file once it has caught up.
+    submitBlock();
+    scheduleDrain();
+}
+
+void MessageRecorderTap::detachRecorder()
+{
+    QMutexLocker locker(&m_mutex);
+    m_recorder = nullptr;
+}
+
+void MessageRecorderTap::submitBlock()
+{
+    if (m_block.isEmpty())
+        return;
+
+    // What is left at close is always written, it is the last block.
+    if (!m_closed && m_blocks.size() >= RecordingMaxPendingBlocks) {
+        m_block.clear();
+        m_block.reserve(RecordingBlockSize);
+        if (!m_dropping) {
+            m_dropping = true;
+            notifyError(QString("Dropping messages: writing “").append(m_file.fileName())
+                .append("” is falling behind"));
+        }
+        return;
+    }
+    m_dropping = false;
+
+    m_blocks.enqueue(m_block);
+    m_block = QByteArray();
+    m_block.reserve(RecordingBlockSize);
+
+    scheduleDrain();
+}
+
+void MessageRecorderTap::scheduleDrain()
+{
+    if (m_writing)
+        return;
+    m_writing = true;
+
+    // A single writer task at any time keeps blocks in order.
+    auto self = shared_from_this();
+    QThreadPool::globalInstance()->start([self] () { self->drain(); });
+}
+
+void MessageRecorderTap::drain()
+{
+    while (true) {
+        QByteArray block;
+        {
+            QMutexLocker locker(&m_mutex);
+            if (m_blocks.isEmpty()) {
+                m_writing = false;
+                if (m_closed) {
+                    m_file.close();
+                    if (m_recorder != nullptr)
+                        invokeQueued(m_recorder, "onTapClosed");
+                }
+                return;
+            }
+            block = m_blocks.dequeue();
+        }
+
+        if (m_compressed)
+            block = qCompress(block, 1);
+
+        QByteArray blockHeader;
+        appendValue<quint32>(blockHeader, block.size());
+        if (m_file.write(blockHeader) != blockHeader.size() || m_file.write(block) != block.size()) {
+            QMutexLocker locker(&m_mutex);
+            m_failed = true;
+            m_blocks.clear();
+            m_block.clear();
+            notifyError(QString("Failed to write “").append(m_file.fileName()).append("”: ")
+                .append(m_file.errorString()));
+        }
+    }
+}
+
+void MessageRecorderTap::notifyError(QString message)
+{
+    if (m_recorder != nullptr)
+        invokeQueued(m_recorder, "onTapError", Q_ARG(QString, message));
+}
+
+MessageRecordingReader::MessageRecordingReader(QString path) :
+    m_file(path),
+    m_compressed(false),
+    m_offset(0)
+{
+}
+
+bool MessageRecordingReader::open(QString *errorMessage)
+{
+    if (!m_file.open(QIODevice::ReadOnly)) {
+        *errorMessage = QString("Failed to open “").append(m_file.fileName()).append("”: ")
+            .append(m_file.errorString());
+        return false;
+    }
+
+    auto header = m_file.read(RecordingHeaderSize);
+    qsizetype offset = sizeof(RecordingMagic);
+    quint32 version, flags;
+    if (header.size() != RecordingHeaderSize || !header.startsWith(QByteArray(RecordingMagic, sizeof(RecordingMagic)))
+            || !takeValue(header, &offset, &version) || version != RecordingVersion
+            || !takeValue(header, &offset, &flags)) {
+        *errorMessage = QString("“").append(m_file.fileName()).append("” is not a message recording");
+        m_file.close();
+        return false;
+    }
+    m_compressed = (flags & RecordingFlagCompressed) != 0;
+
+    return true;
+}
+
+bool MessageRecordingReader::next(MessageRecord *record)
+{
+    if (m_offset == m_block.size() && !readBlock())
+        return false;
+
+    quint32 messageSize;
+    qint32 dataSize;
+    if (!takeValue(m_block, &m_offset, &record->timestamp) || !takeValue(m_block, &m_offset, &record->pid)
+            || !takeValue(m_block, &m_offset, &messageSize) || m_block.size() - m_offset < static_cast<qsizetype>(messageSize)) {
+        m_errorString = "Truncated record";
+        return false;
+    }
+    record->message = m_block.mid(m_offset, messageSize);
+    m_offset += messageSize;
+
+    if (!takeValue(m_block, &m_offset, &dataSize) || m_block.size() - m_offset < qMax(dataSize, 0)) {
+        m_errorString = "Truncated record";
+        return false;
+    }
+    record->hasData = dataSize != -1;
+    record->data = record->hasData ? m_block.mid(m_offset, dataSize) : QByteArray();
+    m_offset += qMax(dataSize, 0);
+
+    return true;
+}
+
+bool MessageRecordingReader::readBlock()
+{
+    auto blockHeader = m_file.read(sizeof(quint32));
+    if (blockHeader.isEmpty())
+        return false;
+
+    qsizetype offset = 0;
+    quint32 size;
+    if (!takeValue(blockHeader, &offset, &size)) {
+        m_errorString = "Truncated block header";
+        return false;
+    }
+
+    auto block = m_file.read(size);
+    if (block.size() != static_cast<qsizetype>(size)) {
+        m_errorString = "Truncated block";
+        return false;
+    }
+
+    m_block = m_compressed ? qUncompress(block) : block;
+    m_offset = 0;
+    if (m_block.isEmpty()) {
+        m_errorString = "Corrupt block";
+        return false;
+    }
+
+    return true;
+}
@@ -0,0 +1,137 @@
+#ifndef FRIDAQML_MESSAGERECORDER_H
+#define FRIDAQML_MESSAGERECORDER_H
+
+#include "messagedispatcher.h"
+
+#include <QFile>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QTimer>
+
+Q_MOC_INCLUDE("script.h")
+class MessageRecorderTap;
+class Script;
+class ScriptInstance;
+
+// Writing happens on a pool thread, including whatever is still pending
+// when recording stops; closed() fires once the file is complete.
+class MessageRecorder : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(MessageRecorder)
+    Q_PROPERTY(Script *script READ script WRITE setScript NOTIFY scriptChanged)
+    Q_PROPERTY(ScriptInstance *instance READ instance WRITE setInstance NOTIFY instanceChanged)
+    Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
+    Q_PROPERTY(bool compressed READ isCompressed WRITE setCompressed NOTIFY compressedChanged)
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    QML_ELEMENT
+
+public:
+    explicit MessageRecorder(QObject *parent = nullptr);
+    ~MessageRecorder();
+
+    Script *script() const { return m_script; }
+    void setScript(Script *script);
+    ScriptInstance *instance() const { return m_instance; }
+    void setInstance(ScriptInstance *instance);
+    QString filePath() const { return m_filePath; }
+    void setFilePath(QString filePath);
+    bool isCompressed() const { return m_compressed; }
+    void setCompressed(bool compressed);
+    bool isActive() const { return m_active; }
+    void setActive(bool active);
+
+Q_SIGNALS:
+    void scriptChanged(Script *newScript);
+    void instanceChanged(ScriptInstance *newInstance);
+    void filePathChanged(QString newFilePath);
+    void compressedChanged(bool newCompressed);
+    void activeChanged(bool newActive);
+    void error(QString message);
+    void closed();
+
+private Q_SLOTS:
+    void flush();
+    void onTapError(QString message);
+    void onTapClosed();
+
+private:
+    void start();
+    void stop();
+    void attach();
+    void detach();
+
+    QPointer<Script> m_script;
+    QPointer<ScriptInstance> m_instance;
+    QString m_filePath;
+    bool m_compressed;
+    bool m_active;
+    std::shared_ptr<MessageRecorderTap> m_tap;
+    std::shared_ptr<MessageRecorderTap> m_closingTap;
+    QTimer m_flushTimer;
+};
+
+// Recordings are a 20-byte header ("FQMR", version, flags, start time in ms
+// since the epoch) followed by blocks of records, each block prefixed with
+// its stored size and zlib-compressed if the flags say so. A record holds
+// the time since the start in µs, the pid, and the length-prefixed message
+// JSON and data bytes, with a data length of -1 meaning no data.
+struct MessageRecord
+{
+    qint64 timestamp;
+    int pid;
+    QByteArray message;
+    QByteArray data;
+    bool hasData;
+};
+
+class MessageRecorderTap : public MessageTap, public std::enable_shared_from_this<MessageRecorderTap>
+{
+public:
+    explicit MessageRecorderTap(MessageRecorder *recorder, QString path, bool compressed);
+
+    bool open(QString *errorMessage);
+    void onMessage(int pid, const QByteArray &message, GBytes *data) override;
+    void flush();
+    void close();
+    void detachRecorder();
+
+private:
+    void submitBlock();
+    void scheduleDrain();
+    void drain();
+    void notifyError(QString message);
+
+    QMutex m_mutex;
+    MessageRecorder *m_recorder;
+    QFile m_file;
+    bool m_compressed;
+    qint64 m_startTime;
+    bool m_closed;
+    bool m_failed;
+    bool m_dropping;
+    QByteArray m_block;
+    QQueue<QByteArray> m_blocks;
+    bool m_writing;
+};
+
+class MessageRecordingReader
+{
+public:
+    explicit MessageRecordingReader(QString path);
+
+    bool open(QString *errorMessage);
+    bool next(MessageRecord *record);
+    QString errorString() const { return m_errorString; }
+
+private:
+    bool readBlock();
+
+    QFile m_file;
+    bool m_compressed;
+    QByteArray m_block;
+    qsizetype m_offset;
+    QString m_errorString;
+};
+
+#endif
@@ -28,6 +28,7 @@ void FridaQmlPlugin::registerTypes(const char *uri)
     qRegisterMetaType<SessionEntry::DetachReason>("SessionEntry::DetachReason");
     qRegisterMetaType<Script::Status>("Script::Status");
     qRegisterMetaType<Script::Runtime>("Script::Runtime");
+    qRegisterMetaType<Script::Encoding>("Script::Encoding");
     qRegisterMetaType<ScriptInstance::Status>("ScriptInstance::Status");
 
     qmlRegisterSingletonType<Frida>(uri, 1, 0, "Frida", createFridaSingleton);
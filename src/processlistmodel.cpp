@@ -5,7 +5,11 @@
 #include "device.h"
 #include "maincontext.h"
 #include "process.h"
+#include "stats.h"
+#include "syntheticprocesssource.h"
+#include "tracing.h"
 
+#include <algorithm>
 #include <QMetaMethod>
 
 static const int ProcessPidRole = Qt::UserRole + 0;
@@ -23,6 +27,7 @@ ProcessListModel::ProcessListModel(QObject *parent) :
     m_isLoading(false),
     m_scope(Frida::Scope::Minimal),
     m_pendingRequest(nullptr),
+    m_syntheticTimer(nullptr),
     m_mainContext(new MainContext(frida_get_main_context()))
 {
 }
@@ -33,6 +38,12 @@ void ProcessListModel::dispose()
         m_pendingRequest->model = nullptr;
         m_pendingRequest = nullptr;
     }
+
+    if (m_syntheticTimer != nullptr) {
+        g_source_destroy(m_syntheticTimer);
+        m_syntheticTimer = nullptr;
+    }
+    m_pendingSyntheticSource.reset();
 }
 
 ProcessListModel::~ProcessListModel()
@@ -50,6 +61,12 @@ Process *ProcessListModel::get(int index) const
 
 void ProcessListModel::refresh()
 {
+    if (m_syntheticSource != nullptr) {
+        auto source = m_syntheticSource;
+        m_mainContext->schedule([this, source] () { enumerateSynthetic(source); });
+        return;
+    }
+
     if (m_device.isNull())
         return;
 
@@ -88,6 +105,16 @@ void ProcessListModel::setScope(Frida::Scope scope)
     hardRefresh();
 }
 
+void ProcessListModel::setSyntheticSource(std::shared_ptr<SyntheticProcessSource> source)
+{
+    if (source == m_syntheticSource)
+        return;
+
+    m_syntheticSource = source;
+
+    hardRefresh();
+}
+
 QHash<int, QByteArray> ProcessListModel::roleNames() const
 {
     QHash<int, QByteArray> r;
@@ -127,15 +154,16 @@ QVariant ProcessListModel::data(const QModelIndex &index, int role) const
 
 void ProcessListModel::hardRefresh()
 {
+    auto source = m_syntheticSource;
     FridaDevice *handle = nullptr;
-    if (m_device != nullptr) {
+    if (source == nullptr && m_device != nullptr) {
         handle = m_device->handle();
         g_object_ref(handle);
     }
 
     auto scope = static_cast<FridaScope>(m_scope);
 
-    m_mainContext->schedule([=] () { finishHardRefresh(handle, scope); });
+    m_mainContext->schedule([=] () { finishHardRefresh(handle, scope, source); });
 
     if (!m_processes.isEmpty()) {
         beginRemoveRows(QModelIndex(), 0, m_processes.size() - 1);
@@ -146,20 +174,28 @@ void ProcessListModel::hardRefresh()
     }
 }
 
-void ProcessListModel::finishHardRefresh(FridaDevice *handle, FridaScope scope)
+void ProcessListModel::finishHardRefresh(FridaDevice *handle, FridaScope scope,
+    std::shared_ptr<SyntheticProcessSource> source)
 {
     m_pids.clear();
 
-    if (handle != nullptr)
+    if (source != nullptr)
+        enumerateSynthetic(source);
+    else if (handle != nullptr)
         enumerateProcesses(handle, scope);
 }
 
 void ProcessListModel::enumerateProcesses(FridaDevice *handle, FridaScope scope)
 {
-    QMetaObject::invokeMethod(this, "beginLoading", Qt::QueuedConnection);
+    invokeQueued(this, "beginLoading");
 
     if (m_pendingRequest != nullptr)
         m_pendingRequest->model = nullptr;
+    if (m_syntheticTimer != nullptr) {
+        g_source_destroy(m_syntheticTimer);
+        m_syntheticTimer = nullptr;
+        m_pendingSyntheticSource.reset();
+    }
 
     auto options = frida_process_query_options_new();
     frida_process_query_options_set_scope(options, scope);
@@ -189,112 +225,184 @@ void ProcessListModel::onEnumerateReady(FridaDevice *handle, GAsyncResult *res)
 {
     m_pendingRequest = nullptr;
 
-    QMetaObject::invokeMethod(this, "endLoading", Qt::QueuedConnection);
+    invokeQueued(this, "endLoading");
 
     GError *error = nullptr;
     auto processHandles = frida_device_enumerate_processes_finish(handle, res, &error);
     if (error == nullptr) {
-        QSet<unsigned int> current;
-        QList<Process *> added;
-        QSet<unsigned int> removed;
-
+        QList<FridaProcess *> processes;
         const int size = frida_process_list_size(processHandles);
-        for (int i = 0; i != size; i++) {
-            auto processHandle = frida_process_list_get(processHandles, i);
-            auto pid = frida_process_get_pid(processHandle);
-            current.insert(pid);
-            if (!m_pids.contains(pid)) {
-                auto process = new Process(processHandle);
-                process->moveToThread(this->thread());
-                added.append(process);
-                m_pids.insert(pid);
-            }
-            g_object_unref(processHandle);
-        }
-
-        for (unsigned int pid : std::as_const(m_pids)) {
-            if (!current.contains(pid)) {
-                removed.insert(pid);
-            }
-        }
-
-        for (unsigned int pid : std::as_const(removed)) {
-            m_pids.remove(pid);
-        }
-
+        processes.reserve(size);
+        for (int i = 0; i != size; i++)
+            processes.append(frida_process_list_get(processHandles, i));
         g_object_unref(processHandles);
 
-        if (!added.isEmpty() || !removed.isEmpty()) {
-            g_object_ref(handle);
-            QMetaObject::invokeMethod(this, "updateItems", Qt::QueuedConnection,
-                Q_ARG(void *, handle),
-                Q_ARG(QList<Process *>, added),
-                Q_ARG(QSet<unsigned int>, removed));
-        }
+        applyProcesses(handle, processes);
     } else {
         auto message = QString("Failed to enumerate processes: ").append(QString::fromUtf8(error->message));
-        QMetaObject::invokeMethod(this, "onError", Qt::QueuedConnection,
+        invokeQueued(this, "onError",
             Q_ARG(QString, message));
         g_clear_error(&error);
     }
 }
 
+void ProcessListModel::enumerateSynthetic(std::shared_ptr<SyntheticProcessSource> source)
+{
+    if (m_pendingRequest != nullptr) {
+        m_pendingRequest->model = nullptr;
+        m_pendingRequest = nullptr;
+    }
+
+    if (m_syntheticTimer != nullptr)
+        g_source_destroy(m_syntheticTimer);
+    else
+        invokeQueued(this, "beginLoading");
+
+    auto timer = (source->latency() != 0) ? g_timeout_source_new(source->latency()) : g_idle_source_new();
+    g_source_set_callback(timer, onSyntheticReadyWrapper, this, nullptr);
+    g_source_attach(timer, m_mainContext->handle());
+    g_source_unref(timer);
+    m_syntheticTimer = timer;
+    m_pendingSyntheticSource = source;
+}
+
+gboolean ProcessListModel::onSyntheticReadyWrapper(gpointer data)
+{
+    static_cast<ProcessListModel *>(data)->onSyntheticReady();
+
+    return FALSE;
+}
+
+void ProcessListModel::onSyntheticReady()
+{
+    m_syntheticTimer = nullptr;
+    auto source = std::move(m_pendingSyntheticSource);
+
+    invokeQueued(this, "endLoading");
+
+    applyProcesses(source->token(), source->enumerate());
+}
+
+void ProcessListModel::applyProcesses(gpointer handle, QList<FridaProcess *> processHandles)
+{
+    QSet<unsigned int> current;
+    QList<Process *> added;
+    QSet<unsigned int> removed;
+
+    for (FridaProcess *processHandle : std::as_const(processHandles)) {
+        auto pid = frida_process_get_pid(processHandle);
+        current.insert(pid);
+        if (!m_pids.contains(pid)) {
+            auto process = new Process(processHandle);
+            process->moveToThread(this->thread());
+            added.append(process);
+            m_pids.insert(pid);
+        }
+        g_object_unref(processHandle);
+    }
+
+    for (unsigned int pid : std::as_const(m_pids)) {
+        if (!current.contains(pid)) {
+            removed.insert(pid);
+        }
+    }
+
+    for (unsigned int pid : std::as_const(removed)) {
+        m_pids.remove(pid);
+    }
+
+    if (!added.isEmpty() || !removed.isEmpty()) {
+        g_object_ref(handle);
+        invokeQueued(this, "updateItems",
+            Q_ARG(void *, handle),
+            Q_ARG(QList<Process *>, added),
+            Q_ARG(QSet<unsigned int>, removed));
+    }
+}
+
+gpointer ProcessListModel::sourceHandle() const
+{
+    if (m_syntheticSource != nullptr)
+        return m_syntheticSource->token();
+
+    return m_device.isNull() ? nullptr : m_device->handle();
+}
+
 int ProcessListModel::score(Process *process)
 {
     return process->hasIcons() ? 1 : 0;
 }
 
+bool ProcessListModel::lessThan(Process *a, Process *b)
+{
+    auto scoreA = score(a);
+    auto scoreB = score(b);
+    if (scoreA != scoreB)
+        return scoreA > scoreB;
+
+    auto nameDifference = a->name().compare(b->name(), Qt::CaseInsensitive);
+    if (nameDifference != 0)
+        return nameDifference < 0;
+
+    return a->pid() < b->pid();
+}
+
 void ProcessListModel::updateItems(void *handle, QList<Process *> added, QSet<unsigned int> removed)
 {
+    FRIDAQML_TRACE_SCOPE("ProcessListModel.updateItems");
+
     for (Process *process : std::as_const(added)) {
         process->setParent(this);
     }
 
     g_object_unref(handle);
 
-    if (m_device.isNull() || handle != m_device->handle())
+    if (handle != sourceHandle())
         return;
 
     int previousCount = m_processes.count();
 
     QModelIndex parentRow;
 
-    for (unsigned int pid : std::as_const(removed)) {
-        auto size = m_processes.size();
-        for (int i = 0; i != size; i++) {
-            auto process = m_processes[i];
-            if (process->pid() == pid) {
-                beginRemoveRows(parentRow, i, i);
-                m_processes.removeAt(i);
-                endRemoveRows();
-                delete process;
-                break;
-            }
+    // Remove in contiguous runs, walking backwards so indexes stay valid.
+    if (!removed.isEmpty()) {
+        for (int i = m_processes.size() - 1; i >= 0; i--) {
+            if (!removed.contains(m_processes[i]->pid()))
+                continue;
+
+            int last = i;
+            while (i > 0 && removed.contains(m_processes[i - 1]->pid()))
+                i--;
+
+            QList<Process *> doomed = m_processes.mid(i, last - i + 1);
+            beginRemoveRows(parentRow, i, last);
+            m_processes.remove(i, last - i + 1);
+            endRemoveRows();
+            qDeleteAll(doomed);
         }
     }
 
-    for (Process *process : std::as_const(added)) {
-        QString name = process->name();
-        auto processScore = score(process);
-        int index = -1;
-        auto size = m_processes.size();
-        for (int i = 0; i != size && index == -1; i++) {
-            auto curProcess = m_processes[i];
-            auto curProcessScore = score(curProcess);
-            if (processScore > curProcessScore) {
-                index = i;
-            } else if (processScore == curProcessScore) {
-                auto nameDifference = name.compare(curProcess->name(), Qt::CaseInsensitive);
-                if (nameDifference < 0 || (nameDifference == 0 && process->pid() < curProcess->pid())) {
-                    index = i;
-                }
-            }
+    // Merge the sorted additions in, inserting runs that land between the
+    // same two existing rows with a single beginInsertRows().
+    std::sort(added.begin(), added.end(), lessThan);
+    int i = 0;
+    while (i != added.size()) {
+        int index = std::upper_bound(m_processes.begin(), m_processes.end(), added[i], lessThan) - m_processes.begin();
+
+        int j = i + 1;
+        if (index == m_processes.size()) {
+            j = added.size();
+        } else {
+            while (j != added.size() && lessThan(added[j], m_processes[index]))
+                j++;
         }
-        if (index == -1)
-            index = size;
-        beginInsertRows(parentRow, index, index);
-        m_processes.insert(index, process);
+
+        beginInsertRows(parentRow, index, index + (j - i) - 1);
+        m_processes.insert(index, j - i, nullptr);
+        std::copy(added.begin() + i, added.begin() + j, m_processes.begin() + index);
         endInsertRows();
+
+        i = j;
     }
 
     int newCount = m_processes.count();
@@ -4,6 +4,7 @@
 #include "frida.h"
 
 #include <frida-core.h>
+#include <memory>
 #include <QAbstractListModel>
 #include <QQmlEngine>
 
@@ -12,6 +13,7 @@ Q_MOC_INCLUDE("process.h")
 class Device;
 class MainContext;
 class Process;
+class SyntheticProcessSource;
 struct EnumerateProcessesRequest;
 
 class ProcessListModel : public QAbstractListModel
@@ -40,6 +42,8 @@ public:
     bool isLoading() const { return m_isLoading; }
     Frida::Scope scope() const { return m_scope; }
     void setScope(Frida::Scope scope);
+    std::shared_ptr<SyntheticProcessSource> syntheticSource() const { return m_syntheticSource; }
+    void setSyntheticSource(std::shared_ptr<SyntheticProcessSource> source);
 
     QHash<int, QByteArray> roleNames() const override;
     int rowCount(const QModelIndex &parent) const override;
@@ -54,12 +58,18 @@ Q_SIGNALS:
 
 private:
     void hardRefresh();
-    void finishHardRefresh(FridaDevice *handle, FridaScope scope);
+    void finishHardRefresh(FridaDevice *handle, FridaScope scope, std::shared_ptr<SyntheticProcessSource> source);
     void enumerateProcesses(FridaDevice *handle, FridaScope scope);
     static void onEnumerateReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
     void onEnumerateReady(FridaDevice *handle, GAsyncResult *res);
+    void enumerateSynthetic(std::shared_ptr<SyntheticProcessSource> source);
+    static gboolean onSyntheticReadyWrapper(gpointer data);
+    void onSyntheticReady();
+    void applyProcesses(gpointer handle, QList<FridaProcess *> processHandles);
+    gpointer sourceHandle() const;
 
     static int score(Process *process);
+    static bool lessThan(Process *a, Process *b);
 
 private Q_SLOTS:
     void updateItems(void *handle, QList<Process *> added, QSet<unsigned int> removed);
@@ -72,8 +82,11 @@ private:
     QList<Process *> m_processes;
     bool m_isLoading;
     Frida::Scope m_scope;
+    std::shared_ptr<SyntheticProcessSource> m_syntheticSource;
 
     EnumerateProcessesRequest *m_pendingRequest;
+    std::shared_ptr<SyntheticProcessSource> m_pendingSyntheticSource;
+    GSource *m_syntheticTimer;
     QSet<unsigned int> m_pids;
 
     QScopedPointer<MainContext> m_mainContext;
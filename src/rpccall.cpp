@@ -0,0 +1,115 @@
+#include "rpccall.h"
+
+RpcCall::RpcCall(int id, QString method, QObject *parent) :
+    QObject(parent),
+    m_id(id),
+    m_method(method),
+    m_status(Status::Pending),
+    m_timeout(0)
+{
+    m_timer.setSingleShot(true);
+    connect(&m_timer, &QTimer::timeout, this, [=] () {
+        reject(QString("Call to “").append(m_method).append("” timed out"));
+    });
+}
+
+void RpcCall::setTimeout(int timeout)
+{
+    if (timeout == m_timeout)
+        return;
+
+    m_timeout = timeout;
+    Q_EMIT timeoutChanged(m_timeout);
+
+    if (m_status != Status::Pending)
+        return;
+
+    if (timeout > 0)
+        m_timer.start(timeout);
+    else
+        m_timer.stop();
+}
+
+void RpcCall::then(QJSValue onResolved, QJSValue onRejected)
+{
+    switch (m_status) {
+    case Status::Pending:
+        if (onResolved.isCallable())
+            m_onResolved.append(onResolved);
+        if (onRejected.isCallable())
+            m_onRejected.append(onRejected);
+        break;
+    case Status::Resolved:
+        invoke(onResolved, m_result);
+        break;
+    case Status::Rejected:
+    case Status::Cancelled:
+        invoke(onRejected, m_errorMessage);
+        break;
+    }
+}
+
+void RpcCall::cancel()
+{
+    if (m_status != Status::Pending)
+        return;
+
+    m_errorMessage = "Call cancelled";
+    settle(Status::Cancelled);
+    Q_EMIT rejected(m_errorMessage);
+
+    for (const QJSValue &callback : std::as_const(m_onRejected))
+        invoke(callback, m_errorMessage);
+    m_onResolved.clear();
+    m_onRejected.clear();
+}
+
+void RpcCall::resolve(QVariant result)
+{
+    if (m_status != Status::Pending)
+        return;
+
+    m_result = result;
+    settle(Status::Resolved);
+    Q_EMIT resolved(m_result);
+
+    for (const QJSValue &callback : std::as_const(m_onResolved))
+        invoke(callback, m_result);
+    m_onResolved.clear();
+    m_onRejected.clear();
+}
+
+void RpcCall::reject(QString message)
+{
+    if (m_status != Status::Pending)
+        return;
+
+    m_errorMessage = message;
+    settle(Status::Rejected);
+    Q_EMIT rejected(m_errorMessage);
+
+    for (const QJSValue &callback : std::as_const(m_onRejected))
+        invoke(callback, m_errorMessage);
+    m_onResolved.clear();
+    m_onRejected.clear();
+}
+
+void RpcCall::settle(Status status)
+{
+    m_timer.stop();
+
+    m_status = status;
+    Q_EMIT statusChanged(m_status);
+}
+
+void RpcCall::invoke(QJSValue callback, QVariant argument)
+{
+    if (!callback.isCallable())
+        return;
+
+    auto engine = qjsEngine(this);
+    if (engine == nullptr)
+        return;
+
+    callback.call(QJSValueList { engine->toScriptValue(argument) });
+}
@@ -0,0 +1,61 @@
+#ifndef FRIDAQML_RPCCALL_H
+#define FRIDAQML_RPCCALL_H
+
+#include <QJSValue>
+#include <QQmlEngine>
+#include <QTimer>
+
+class RpcCall : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(RpcCall)
+    Q_PROPERTY(QString method READ method CONSTANT FINAL)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(QVariant result READ result NOTIFY statusChanged)
+    Q_PROPERTY(QString errorMessage READ errorMessage NOTIFY statusChanged)
+    Q_PROPERTY(int timeout READ timeout WRITE setTimeout NOTIFY timeoutChanged)
+    QML_ELEMENT
+    QML_UNCREATABLE("RpcCall objects cannot be instantiated from Qml");
+
+public:
+    enum class Status { Pending, Resolved, Rejected, Cancelled };
+    Q_ENUM(Status)
+
+    explicit RpcCall(int id, QString method, QObject *parent = nullptr);
+
+    int id() const { return m_id; }
+    QString method() const { return m_method; }
+    Status status() const { return m_status; }
+    QVariant result() const { return m_result; }
+    QString errorMessage() const { return m_errorMessage; }
+    int timeout() const { return m_timeout; }
+    void setTimeout(int timeout);
+
+    Q_INVOKABLE void then(QJSValue onResolved, QJSValue onRejected = QJSValue());
+    Q_INVOKABLE void cancel();
+
+    void resolve(QVariant result);
+    void reject(QString message);
+
+Q_SIGNALS:
+    void statusChanged(Status newStatus);
+    void timeoutChanged(int newTimeout);
+    void resolved(QVariant result);
+    void rejected(QString message);
+
+private:
+    void settle(Status status);
+    void invoke(QJSValue callback, QVariant argument);
+
+    int m_id;
+    QString m_method;
+    Status m_status;
+    QVariant m_result;
+    QString m_errorMessage;
+    int m_timeout;
+    QTimer m_timer;
+    QList<QJSValue> m_onResolved;
+    QList<QJSValue> m_onRejected;
+};
+
+#endif
@@ -1,14 +1,66 @@
+#include <frida-core.h>
+
 #include "script.h"
 
+#include "bytecodecache.h"
+#include "device.h"
+#include "logsink.h"
+#include "rpccall.h"
+#include "scriptinstancelistmodel.h"
+#include "tracing.h"
+
+#include <QCoreApplication>
+#include <QDir>
+#include <QFileInfo>
 #include <QJsonObject>
-#include <QNetworkReply>
+#include <QMetaMethod>
+#include <QNetworkAccessManager>
+#include <QNetworkDiskCache>
 #include <QNetworkRequest>
+#include <QStandardPaths>
+
+// Agents smaller than this are read rather than mapped; copying them is
+// cheap, and a copy cannot fault if the file is truncated under us.
+static const qint64 MappedCodeThreshold = 1024 * 1024;
+
+static QNetworkAccessManager *networkAccessManager()
+{
+    static QPointer<QNetworkAccessManager> manager;
+
+    if (manager == nullptr) {
+        manager = new QNetworkAccessManager(QCoreApplication::instance());
+
+        auto cacheLocation = QStandardPaths::writableLocation(QStandardPaths::CacheLocation);
+        if (!cacheLocation.isEmpty()) {
+            auto cache = new QNetworkDiskCache(manager);
+            cache->setCacheDirectory(QDir(cacheLocation).filePath("frida-qml/agents"));
+            manager->setCache(cache);
+        }
+    }
+
+    return manager;
+}
 
 Script::Script(QObject *parent) :
     QObject(parent),
     m_status(Status::Loaded),
-    m_runtime(Runtime::Default)
+    m_runtime(Runtime::Default),
+    m_watch(false),
+    m_watchInterval(2000),
+    m_offloadMessages(false),
+    m_encoding(Encoding::Json),
+    m_instanceModel(new ScriptInstanceListModel(this)),
+    m_stopping(false)
 {
+    m_watchTimer.setSingleShot(true);
+    connect(&m_watchTimer, &QTimer::timeout, this, &Script::poll);
+
+    // Editors tend to save in several steps, so wait for the file to settle.
+    m_reloadTimer.setSingleShot(true);
+    m_reloadTimer.setInterval(100);
+    connect(&m_reloadTimer, &QTimer::timeout, this, &Script::reloadLocalFile);
+    connect(&m_fileWatcher, &QFileSystemWatcher::fileChanged, this, &Script::onWatchedPathChanged);
+    connect(&m_fileWatcher, &QFileSystemWatcher::directoryChanged, this, &Script::onWatchedPathChanged);
 }
 
 void Script::setUrl(QUrl url)
@@ -16,34 +68,216 @@ void Script::setUrl(QUrl url)
     if (url == m_url)
         return;
 
-    QNetworkRequest request(url);
-    auto reply = m_networkAccessManager.get(request);
+    cancelFetch();
+
+    m_url = url;
+    Q_EMIT urlChanged(m_url);
+
     m_status = Status::Loading;
     Q_EMIT statusChanged(m_status);
-    connect(reply, &QNetworkReply::finished, [=] () {
+
+    QString localPath;
+    if (url.isLocalFile())
+        localPath = url.toLocalFile();
+    else if (url.scheme() == "qrc")
+        localPath = QString(":").append(url.path());
+
+    if (!localPath.isEmpty())
+        loadLocalFile(localPath);
+    else
+        fetch();
+
+    updateWatch();
+}
+
+void Script::fetch()
+{
+    cancelFetch();
+
+    // Revalidate against the disk cache, so unchanged agents cost a 304
+    // instead of a full download.
+    QNetworkRequest request(m_url);
+    request.setAttribute(QNetworkRequest::CacheLoadControlAttribute, QNetworkRequest::PreferNetwork);
+    auto reply = networkAccessManager()->get(request);
+    m_pendingReply = reply;
+
+    connect(reply, &QNetworkReply::finished, this, [=] () {
+        reply->deleteLater();
+
+        if (reply != m_pendingReply)
+            return;
+        m_pendingReply = nullptr;
+
         if (m_status == Status::Loading) {
-            if (reply->error() == QNetworkReply::NoError) {
-                if (m_name.isEmpty()) {
-                    setName(url.fileName(QUrl::FullyDecoded).section(".", 0, 0));
-                }
-
-                m_code = reply->readAll();
-                Q_EMIT codeChanged(m_code);
-
-                m_status = Status::Loaded;
-                Q_EMIT statusChanged(m_status);
-            } else {
-                Q_EMIT error(nullptr, QString("Failed to load “").append(url.toString()).append("”"));
-
-                m_status = Status::Error;
-                Q_EMIT statusChanged(m_status);
-            }
+            if (reply->error() == QNetworkReply::NoError)
+                finishLoad(reply->readAll(), nullptr);
+            else
+                failLoad();
+        } else if (reply->error() == QNetworkReply::NoError) {
+            replaceCode(reply->readAll());
         }
 
-        reply->deleteLater();
+        updateWatch();
     });
 }
 
+void Script::cancelFetch()
+{
+    if (m_pendingReply == nullptr)
+        return;
+
+    QNetworkReply *superseded = m_pendingReply;
+    m_pendingReply = nullptr;
+    superseded->abort();
+}
+
+void Script::poll()
+{
+    if (m_status == Status::Loaded && m_pendingReply == nullptr)
+        fetch();
+}
+
+void Script::updateWatch()
+{
+    auto remote = !m_url.isEmpty() && !m_url.isLocalFile() && m_url.scheme() != "qrc";
+    if (m_watch && remote && m_watchInterval > 0 && m_pendingReply == nullptr)
+        m_watchTimer.start(m_watchInterval);
+    else
+        m_watchTimer.stop();
+
+    auto path = watchedFilePath();
+    auto directory = QFileInfo(path).absolutePath();
+
+    auto stalePaths = m_fileWatcher.files() + m_fileWatcher.directories();
+    if (!path.isEmpty()) {
+        stalePaths.removeAll(path);
+        stalePaths.removeAll(directory);
+    }
+    if (!stalePaths.isEmpty())
+        m_fileWatcher.removePaths(stalePaths);
+
+    if (path.isEmpty()) {
+        m_reloadTimer.stop();
+        return;
+    }
+
+    // Watch the directory too, as saving by rename replaces the file we
+    // were watching.
+    if (!m_fileWatcher.directories().contains(directory))
+        m_fileWatcher.addPath(directory);
+    if (!m_fileWatcher.files().contains(path) && QFile::exists(path))
+        m_fileWatcher.addPath(path);
+}
+
+QString Script::watchedFilePath() const
+{
+    if (!m_watch || !m_url.isLocalFile())
+        return QString();
+
+    return QFileInfo(m_url.toLocalFile()).absoluteFilePath();
+}
+
+void Script::onWatchedPathChanged()
+{
+    auto path = watchedFilePath();
+    if (path.isEmpty())
+        return;
+
+    if (!m_fileWatcher.files().contains(path) && QFile::exists(path))
+        m_fileWatcher.addPath(path);
+
+    m_reloadTimer.start();
+}
+
+void Script::reloadLocalFile()
+{
+    if (m_status != Status::Loaded)
+        return;
+
+    auto path = watchedFilePath();
+    if (path.isEmpty())
+        return;
+
+    QFile file(path);
+    if (!file.open(QIODevice::ReadOnly))
+        return;
+
+    replaceCode(file.readAll());
+}
+
+void Script::loadLocalFile(QString path)
+{
+    auto file = std::make_shared<QFile>(path);
+    if (!file->open(QIODevice::ReadOnly)) {
+        failLoad();
+        return;
+    }
+
+    // A watched file gets rewritten in place, which would pull the pages
+    // out from under a mapping.
+    if (m_watch) {
+        finishLoad(file->readAll(), nullptr);
+        return;
+    }
+
+    // Map large agents instead of reading them, so every instance shares the
+    // same pages and multi-megabyte bundles are never copied on the GUI
+    // thread. Compressed resources cannot be mapped, so those are read as
+    // usual.
+    auto size = file->size();
+    auto data = (size >= MappedCodeThreshold) ? file->map(0, size) : nullptr;
+    if (data != nullptr)
+        finishLoad(QByteArray::fromRawData(reinterpret_cast<const char *>(data), size), file);
+    else
+        finishLoad(file->readAll(), nullptr);
+}
+
+void Script::finishLoad(QByteArray code, std::shared_ptr<QFile> mapping)
+{
+    if (m_name.isEmpty())
+        setName(m_url.fileName(QUrl::FullyDecoded).section(".", 0, 0));
+
+    m_code = code;
+    m_codeMapping = mapping;
+    updateBytecodeCache();
+    if (mapping == nullptr || isSignalConnected(QMetaMethod::fromSignal(&Script::codeChanged)))
+        Q_EMIT codeChanged(code());
+
+    m_status = Status::Loaded;
+    Q_EMIT statusChanged(m_status);
+}
+
+void Script::replaceCode(QByteArray code)
+{
+    if (code == m_code)
+        return;
+
+    m_code = code;
+    m_codeMapping.reset();
+    updateBytecodeCache();
+    Q_EMIT codeChanged(m_code);
+
+    for (QObject *obj : std::as_const(m_instances))
+        Q_EMIT qobject_cast<ScriptInstance *>(obj)->reloadRequest();
+}
+
+QByteArray Script::code() const
+{
+    // m_code aliases the mapping, so it must not escape without it. Devices
+    // get the mapping alongside; everyone else gets a copy.
+    if (m_codeMapping != nullptr)
+        return QByteArray(m_code.constData(), m_code.size());
+    return m_code;
+}
+
+void Script::failLoad()
+{
+    Q_EMIT error(nullptr, QString("Failed to load “").append(m_url.toString()).append("”"));
+
+    m_status = Status::Error;
+    Q_EMIT statusChanged(m_status);
+}
+
 void Script::setName(QString name)
 {
     if (name == m_name)
@@ -59,12 +293,17 @@ void Script::setRuntime(Runtime runtime)
         return;
 
     m_runtime = runtime;
+    updateBytecodeCache();
     Q_EMIT runtimeChanged(m_runtime);
 }
 
 void Script::setCode(QByteArray code)
 {
+    cancelFetch();
+
     m_code = code;
+    m_codeMapping.reset();
+    updateBytecodeCache();
     Q_EMIT codeChanged(m_code);
 
     if (m_status == Status::Loading) {
@@ -73,6 +312,77 @@ void Script::setCode(QByteArray code)
     }
 }
 
+void Script::setWatch(bool watch)
+{
+    if (watch == m_watch)
+        return;
+
+    m_watch = watch;
+    updateWatch();
+    Q_EMIT watchChanged(m_watch);
+}
+
+void Script::setWatchInterval(int watchInterval)
+{
+    if (watchInterval == m_watchInterval)
+        return;
+
+    m_watchInterval = watchInterval;
+    updateWatch();
+    Q_EMIT watchIntervalChanged(m_watchInterval);
+}
+
+void Script::setOffloadMessages(bool offloadMessages)
+{
+    if (offloadMessages == m_offloadMessages)
+        return;
+
+    m_offloadMessages = offloadMessages;
+    Q_EMIT offloadMessagesChanged(m_offloadMessages);
+}
+
+void Script::setEncoding(Encoding encoding)
+{
+    if (encoding == m_encoding)
+        return;
+
+    m_encoding = encoding;
+    Q_EMIT encodingChanged(m_encoding);
+}
+
+void Script::setLogSink(LogSink *logSink)
+{
+    if (logSink == m_logSink)
+        return;
+
+    m_logSink = logSink;
+    Q_EMIT logSinkChanged(logSink);
+
+    for (QObject *obj : std::as_const(m_instances))
+        qobject_cast<ScriptInstance *>(obj)->updateLogSink();
+}
+
+void Script::setCacheDirectory(QString cacheDirectory)
+{
+    if (cacheDirectory == m_cacheDirectory)
+        return;
+
+    m_cacheDirectory = cacheDirectory;
+    updateBytecodeCache();
+    Q_EMIT cacheDirectoryChanged(m_cacheDirectory);
+}
+
+void Script::updateBytecodeCache()
+{
+    // Keyed per device and looked up when an instance is created, so the
+    // GUI thread never hashes the code or reads the cache.
+    if (m_cacheDirectory.isEmpty() || m_runtime == Runtime::V8 || m_code.isEmpty() ||
+            m_code.startsWith(QUICKJS_BYTECODE_MAGIC))
+        m_bytecodeCache.reset();
+    else
+        m_bytecodeCache = std::make_shared<BytecodeCache>(m_cacheDirectory, m_runtime, m_code, m_codeMapping);
+}
+
 void Script::resumeProcess()
 {
     for (QObject *obj : std::as_const(m_instances))
@@ -81,8 +391,61 @@ void Script::resumeProcess()
 
 void Script::stop()
 {
-    for (QObject *obj : std::as_const(m_instances))
+    if (m_instances.isEmpty() || m_stopping)
+        return;
+
+    // Each instance unbinds itself as it stops, so work on a copy. Those
+    // unbinds are collected and applied to the list and model in one go
+    // afterwards. Devices likewise hold on to their stops until all
+    // instances are done, and then hop over to their thread once with the
+    // whole batch.
+    auto instances = m_instances;
+    QList<QPointer<Device>> devices;
+    for (QObject *obj : std::as_const(instances)) {
+        auto device = qobject_cast<ScriptInstance *>(obj)->device();
+        if (device != nullptr && !devices.contains(device)) {
+            device->beginStopBatch();
+            devices.append(device);
+        }
+    }
+
+    m_stopping = true;
+    for (QObject *obj : std::as_const(instances))
         qobject_cast<ScriptInstance *>(obj)->stop();
+    m_stopping = false;
+
+    m_instances.removeIf([&] (QObject *obj) {
+        return m_stopped.contains(qobject_cast<ScriptInstance *>(obj));
+    });
+    m_instanceModel->removeAll(m_stopped);
+    m_stopped.clear();
+
+    for (const auto &device : std::as_const(devices)) {
+        if (!device.isNull())
+            device->endStopBatch();
+    }
+
+    Q_EMIT instancesChanged(m_instances);
+}
+
+void Script::restart()
+{
+    QList<QPair<QPointer<Device>, int>> targets;
+    for (QObject *obj : std::as_const(m_instances)) {
+        auto instance = qobject_cast<ScriptInstance *>(obj);
+        if (instance->device() != nullptr && instance->pid() != -1
+                && instance->status() != ScriptInstance::Status::Destroyed)
+            targets.append(qMakePair(QPointer<Device>(instance->device()), instance->pid()));
+    }
+
+    stop();
+
+    // The stops were scheduled first, so each device unloads the old
+    // instances before it attaches the new ones.
+    for (const auto &target : std::as_const(targets)) {
+        if (!target.first.isNull())
+            target.first->inject(this, target.second);
+    }
 }
 
 void Script::post(QJsonObject object)
@@ -121,15 +484,27 @@ void Script::disableDebugger()
         qobject_cast<ScriptInstance *>(obj)->disableDebugger();
 }
 
+void Script::addMessageTap(std::shared_ptr<MessageTap> tap)
+{
+    m_messageTaps.append(tap);
+
+    for (QObject *obj : std::as_const(m_instances))
+        Q_EMIT qobject_cast<ScriptInstance *>(obj)->attachMessageTapsRequest();
+}
+
+void Script::removeMessageTap(std::shared_ptr<MessageTap> tap)
+{
+    if (!m_messageTaps.removeOne(tap))
+        return;
+
+    for (QObject *obj : std::as_const(m_instances))
+        Q_EMIT qobject_cast<ScriptInstance *>(obj)->attachMessageTapsRequest();
+}
+
 ScriptInstance *Script::bind(Device *device, int pid)
 {
-    if (pid != -1) {
-        for (QObject *obj : std::as_const(m_instances)) {
-            auto instance = qobject_cast<ScriptInstance *>(obj);
-            if (instance->device() == device && instance->pid() == pid)
-                return nullptr;
-        }
-    }
+    if (pid != -1 && m_instancesByPid.contains(qMakePair(device, pid)))
+        return nullptr;
 
     auto instance = new ScriptInstance(device, pid, this);
     connect(instance, &ScriptInstance::error, [=] (QString message) {
@@ -139,16 +514,53 @@ ScriptInstance *Script::bind(Device *device, int pid)
         Q_EMIT message(instance, object, data);
     });
 
+    if (pid != -1) {
+        m_instancesByPid[qMakePair(device, pid)] = instance;
+    } else {
+        connect(instance, &ScriptInstance::pidChanged, [=] (int newPid) {
+            auto key = qMakePair(device, newPid);
+            if (!m_instancesByPid.contains(key))
+                m_instancesByPid[key] = instance;
+        });
+    }
+
     m_instances.append(instance);
+    m_instanceModel->add(instance);
     Q_EMIT instancesChanged(m_instances);
 
     return instance;
 }
 
+ScriptInstance *Script::bindDetached()
+{
+    // Not backed by any device; the caller feeds it messages through
+    // MessageDispatcher, as ScriptReplay does.
+    auto instance = bind(nullptr, -1);
+    instance->startDetached();
+    return instance;
+}
+
+void Script::unbindDetached(ScriptInstance *instance)
+{
+    if (instance->device() == nullptr)
+        unbind(instance);
+}
+
 void Script::unbind(ScriptInstance *instance)
 {
-    m_instances.removeOne(instance);
-    Q_EMIT instancesChanged(m_instances);
+    auto key = qMakePair(instance->device(), instance->pid());
+    if (m_instancesByPid.value(key) == instance)
+        m_instancesByPid.remove(key);
+
+    if (m_stopping) {
+        m_stopped.insert(instance);
+    } else {
+        // The model keeps its rows in the same order as m_instances.
+        auto rowIndex = m_instanceModel->remove(instance);
+        if (rowIndex != -1)
+            m_instances.removeAt(rowIndex);
+        Q_EMIT instancesChanged(m_instances);
+    }
 
     instance->deleteLater();
 }
@@ -158,7 +570,10 @@ ScriptInstance::ScriptInstance(Device *device, int pid, Script *parent) :
     m_status(Status::Loading),
     m_device(device),
     m_pid(pid),
-    m_processState((pid == -1) ? ProcessState::Spawning : ProcessState::Running)
+    m_processState((pid == -1) ? ProcessState::Spawning : ProcessState::Running),
+    m_autoResume(false),
+    m_interrupted(false),
+    m_nextRpcId(1)
 {
 }
 
@@ -176,6 +591,32 @@ void ScriptInstance::onResumeComplete()
     Q_EMIT processStateChanged(m_processState);
 }
 
+void ScriptInstance::onTiming(QString stage, double milliseconds)
+{
+    m_timings[stage] = milliseconds;
+    Q_EMIT timingsChanged(m_timings);
+}
+
+void ScriptInstance::onInterrupted(bool interrupted)
+{
+    if (interrupted == m_interrupted || m_status == Status::Destroyed)
+        return;
+
+    m_interrupted = interrupted;
+    Q_EMIT interruptedChanged(m_interrupted);
+}
+
+void ScriptInstance::setLogSink(LogSink *logSink)
+{
+    if (logSink == m_logSink)
+        return;
+
+    m_logSink = logSink;
+    Q_EMIT logSinkChanged(logSink);
+
+    updateLogSink();
+}
+
 void ScriptInstance::resumeProcess()
 {
     if (m_processState != ProcessState::Paused)
@@ -196,6 +637,8 @@ void ScriptInstance::stop()
 
     m_status = Status::Destroyed;
     Q_EMIT statusChanged(m_status);
+
+    rejectRpcCalls("Script destroyed");
 }
 
 void ScriptInstance::post(QJsonObject object)
@@ -228,6 +671,64 @@ void ScriptInstance::disableDebugger()
     Q_EMIT disableDebuggerRequest();
 }
 
+RpcCall *ScriptInstance::call(QString method, QJsonArray args)
+{
+    auto id = m_nextRpcId++;
+
+    // Owned by the instance rather than the JS engine, so a pending call is
+    // not collected while frida still holds on to its id. Once settled it is
+    // handed to the JS engine if QML has seen it, and otherwise stays with
+    // the instance until the caller deletes it or the instance goes away.
+    auto call = new RpcCall(id, method, this);
+    QQmlEngine::setObjectOwnership(call, QQmlEngine::CppOwnership);
+    connect(call, &RpcCall::statusChanged, this, [=] () {
+        // Still tracked means it was cancelled or timed out on our side.
+        if (m_rpcCalls.remove(id) != 0)
+            Q_EMIT abandonRpcCallRequest(id);
+
+        if (qjsEngine(call) != nullptr) {
+            call->setParent(nullptr);
+            QQmlEngine::setObjectOwnership(call, QQmlEngine::JavaScriptOwnership);
+        }
+    });
+
+    if (m_status == Status::Error || m_status == Status::Destroyed) {
+        call->reject("Script is not running");
+        return call;
+    }
+
+    m_rpcCalls[id] = call;
+
+    Q_EMIT rpcCallRequest(id, QJsonArray { "frida:rpc", id, "call", method, args });
+
+    return call;
+}
+
+MessageTapList ScriptInstance::messageTaps() const
+{
+    return qobject_cast<Script *>(parent())->messageTaps() + m_messageTaps;
+}
+
+void ScriptInstance::addMessageTap(std::shared_ptr<MessageTap> tap)
+{
+    m_messageTaps.append(tap);
+    Q_EMIT attachMessageTapsRequest();
+}
+
+void ScriptInstance::removeMessageTap(std::shared_ptr<MessageTap> tap)
+{
+    if (m_messageTaps.removeOne(tap))
+        Q_EMIT attachMessageTapsRequest();
+}
+
+void ScriptInstance::startDetached()
+{
+    m_processState = ProcessState::Running;
+    Q_EMIT processStateChanged(m_processState);
+
+    onStatus(Status::Started);
+}
+
 void ScriptInstance::onStatus(Status status)
 {
     if (m_status == Status::Destroyed)
@@ -236,8 +737,15 @@ void ScriptInstance::onStatus(Status status)
     m_status = status;
     Q_EMIT statusChanged(status);
 
-    if (status == Status::Error)
+    if (status == Status::Started && m_autoResume) {
+        m_autoResume = false;
+        resumeProcess();
+    }
+
+    if (status == Status::Error) {
+        rejectRpcCalls("Script failed");
         Q_EMIT stopRequest();
+    }
 }
 
 void ScriptInstance::onError(QString message)
@@ -250,8 +758,62 @@ void ScriptInstance::onError(QString message)
 
 void ScriptInstance::onMessage(QJsonObject object, QVariant data)
 {
+    FRIDAQML_TRACE_SCOPE("ScriptInstance.onMessage");
+
     if (m_status == Status::Destroyed)
         return;
 
     Q_EMIT message(object, data);
 }
+
+void ScriptInstance::onRpcReply(int id, QJsonArray reply, QVariant data)
+{
+    QPointer<RpcCall> call = m_rpcCalls.take(id);
+    if (call.isNull())
+        return;
+
+    if (reply[2].toString() == "ok")
+        call->resolve(data.isValid() ? data : reply[3].toVariant());
+    else
+        call->reject(reply[3].toString());
+}
+
+void ScriptInstance::onReloaded(QList<int> abortedRpcCalls)
+{
+    if (m_status == Status::Destroyed)
+        return;
+
+    for (int id : std::as_const(abortedRpcCalls)) {
+        auto call = m_rpcCalls.take(id);
+        if (!call.isNull())
+            call->reject("Script reloaded");
+    }
+
+    Q_EMIT reloaded();
+}
+
+void ScriptInstance::rejectRpcCalls(QString message)
+{
+    auto calls = m_rpcCalls.values();
+    m_rpcCalls.clear();
+
+    for (const QPointer<RpcCall> &call : std::as_const(calls)) {
+        if (!call.isNull())
+            call->reject(message);
+    }
+}
+
+void ScriptInstance::updateLogSink()
+{
+    LogSink *sink = !m_logSink.isNull() ? m_logSink.data() : qobject_cast<Script *>(parent())->logSink();
+    if (sink == m_effectiveLogSink)
+        return;
+
+    if (!m_effectiveLogSink.isNull())
+        disconnect(m_effectiveLogSink, &QObject::destroyed, this, &ScriptInstance::updateLogSink);
+    m_effectiveLogSink = sink;
+    if (sink != nullptr)
+        connect(sink, &QObject::destroyed, this, &ScriptInstance::updateLogSink);
+
+    Q_EMIT attachLogSinkRequest(sink);
+}
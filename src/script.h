@@ -1,14 +1,31 @@
 #ifndef FRIDAQML_SCRIPT_H
 #define FRIDAQML_SCRIPT_H
 
+#include "messagedispatcher.h"
+
+#include <QFile>
+#include <QFileSystemWatcher>
+#include <QHash>
 #include <QJsonArray>
 #include <QJsonObject>
-#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QPointer>
 #include <QQmlEngine>
+#include <QSet>
+#include <QTimer>
+
+#define QUICKJS_BYTECODE_MAGIC 0x02
 
 Q_MOC_INCLUDE("device.h")
+Q_MOC_INCLUDE("logsink.h")
+Q_MOC_INCLUDE("rpccall.h")
+Q_MOC_INCLUDE("scriptinstancelistmodel.h")
+class BytecodeCache;
 class Device;
+class LogSink;
+class RpcCall;
 class ScriptInstance;
+class ScriptInstanceListModel;
 
 class Script : public QObject
 {
@@ -19,7 +36,14 @@ class Script : public QObject
     Q_PROPERTY(QString name READ name WRITE setName NOTIFY nameChanged)
     Q_PROPERTY(Runtime runtime READ runtime WRITE setRuntime NOTIFY runtimeChanged)
     Q_PROPERTY(QByteArray code READ code WRITE setCode NOTIFY codeChanged)
+    Q_PROPERTY(bool watch READ watch WRITE setWatch NOTIFY watchChanged)
+    Q_PROPERTY(int watchInterval READ watchInterval WRITE setWatchInterval NOTIFY watchIntervalChanged)
+    Q_PROPERTY(bool offloadMessages READ offloadMessages WRITE setOffloadMessages NOTIFY offloadMessagesChanged)
+    Q_PROPERTY(Encoding encoding READ encoding WRITE setEncoding NOTIFY encodingChanged)
+    Q_PROPERTY(LogSink *logSink READ logSink WRITE setLogSink NOTIFY logSinkChanged)
+    Q_PROPERTY(QString cacheDirectory READ cacheDirectory WRITE setCacheDirectory NOTIFY cacheDirectoryChanged)
     Q_PROPERTY(QList<QObject *> instances READ instances NOTIFY instancesChanged)
+    Q_PROPERTY(ScriptInstanceListModel *instanceModel READ instanceModel CONSTANT FINAL)
     QML_ELEMENT
 
 public:
@@ -29,6 +53,9 @@ public:
     enum class Runtime { Default, QJS, V8 };
     Q_ENUM(Runtime)
 
+    enum class Encoding { Json, Cbor };
+    Q_ENUM(Encoding)
+
     explicit Script(QObject *parent = nullptr);
 
     Status status() const { return m_status; }
@@ -38,12 +65,26 @@ public:
     void setName(QString name);
     Runtime runtime() const { return m_runtime; }
     void setRuntime(Runtime runtime);
-    QByteArray code() const { return m_code; }
+    QByteArray code() const;
     void setCode(QByteArray code);
+    bool watch() const { return m_watch; }
+    void setWatch(bool watch);
+    int watchInterval() const { return m_watchInterval; }
+    void setWatchInterval(int watchInterval);
+    bool offloadMessages() const { return m_offloadMessages; }
+    void setOffloadMessages(bool offloadMessages);
+    Encoding encoding() const { return m_encoding; }
+    void setEncoding(Encoding encoding);
+    LogSink *logSink() const { return m_logSink; }
+    void setLogSink(LogSink *logSink);
+    QString cacheDirectory() const { return m_cacheDirectory; }
+    void setCacheDirectory(QString cacheDirectory);
     QList<QObject *> instances() const { return m_instances; }
+    ScriptInstanceListModel *instanceModel() const { return m_instanceModel; }
     Q_INVOKABLE void resumeProcess();
 
     Q_INVOKABLE void stop();
+    Q_INVOKABLE void restart();
     Q_INVOKABLE void post(QJsonObject object);
     Q_INVOKABLE void post(QJsonArray array);
 
@@ -51,7 +92,28 @@ public:
     Q_INVOKABLE void enableDebugger(quint16 basePort);
     Q_INVOKABLE void disableDebugger();
 
+    MessageTapList messageTaps() const { return m_messageTaps; }
+    void addMessageTap(std::shared_ptr<MessageTap> tap);
+    void removeMessageTap(std::shared_ptr<MessageTap> tap);
+
+    ScriptInstance *bindDetached();
+    void unbindDetached(ScriptInstance *instance);
+
+private Q_SLOTS:
+    void poll();
+    void onWatchedPathChanged();
+    void reloadLocalFile();
+
 private:
+    void fetch();
+    void cancelFetch();
+    void loadLocalFile(QString path);
+    void finishLoad(QByteArray code, std::shared_ptr<QFile> mapping);
+    void failLoad();
+    void replaceCode(QByteArray code);
+    void updateWatch();
+    QString watchedFilePath() const;
+    void updateBytecodeCache();
     void post(QJsonValue value);
     ScriptInstance *bind(Device *device, int pid);
     void unbind(ScriptInstance *instance);
@@ -61,7 +123,13 @@ Q_SIGNALS:
     void urlChanged(QUrl newUrl);
     void nameChanged(QString newName);
     void runtimeChanged(Runtime newRuntime);
-    void codeChanged(QString newCode);
+    void codeChanged(QByteArray newCode);
+    void watchChanged(bool newWatch);
+    void watchIntervalChanged(int newWatchInterval);
+    void offloadMessagesChanged(bool newOffloadMessages);
+    void encodingChanged(Encoding newEncoding);
+    void logSinkChanged(LogSink *newLogSink);
+    void cacheDirectoryChanged(QString newCacheDirectory);
     void instancesChanged(QList<QObject *> newInstances);
     void error(ScriptInstance *sender, QString message);
     void message(ScriptInstance *sender, QJsonObject object, QVariant data);
@@ -72,8 +140,24 @@ private:
     QString m_name;
     Runtime m_runtime;
     QByteArray m_code;
-    QNetworkAccessManager m_networkAccessManager;
+    std::shared_ptr<QFile> m_codeMapping;
+    bool m_watch;
+    int m_watchInterval;
+    QTimer m_watchTimer;
+    QFileSystemWatcher m_fileWatcher;
+    QTimer m_reloadTimer;
+    bool m_offloadMessages;
+    Encoding m_encoding;
+    QPointer<LogSink> m_logSink;
+    QString m_cacheDirectory;
+    std::shared_ptr<BytecodeCache> m_bytecodeCache;
+    MessageTapList m_messageTaps;
+    QPointer<QNetworkReply> m_pendingReply;
     QList<QObject *> m_instances;
+    ScriptInstanceListModel *m_instanceModel;
+    QHash<QPair<Device *, int>, ScriptInstance *> m_instancesByPid;
+    bool m_stopping;
+    QSet<ScriptInstance *> m_stopped;
 
     friend class Device;
 };
@@ -86,6 +170,9 @@ class ScriptInstance : public QObject
     Q_PROPERTY(Device *device READ device CONSTANT FINAL)
     Q_PROPERTY(int pid READ pid NOTIFY pidChanged)
     Q_PROPERTY(ProcessState processState READ processState NOTIFY processStateChanged)
+    Q_PROPERTY(bool interrupted READ isInterrupted NOTIFY interruptedChanged)
+    Q_PROPERTY(LogSink *logSink READ logSink WRITE setLogSink NOTIFY logSinkChanged)
+    Q_PROPERTY(QVariantMap timings READ timings NOTIFY timingsChanged)
     QML_ELEMENT
     QML_UNCREATABLE("ScriptInstance objects cannot be instantiated from Qml");
 
@@ -102,6 +189,10 @@ public:
     Device *device() const { return m_device; }
     int pid() const { return m_pid; }
     ProcessState processState() const { return m_processState; }
+    bool isInterrupted() const { return m_interrupted; }
+    LogSink *logSink() const { return m_logSink; }
+    void setLogSink(LogSink *logSink);
+    QVariantMap timings() const { return m_timings; }
     Q_INVOKABLE void resumeProcess();
 
     Q_INVOKABLE void stop();
@@ -112,18 +203,36 @@ public:
     Q_INVOKABLE void enableDebugger(quint16 port);
     Q_INVOKABLE void disableDebugger();
 
+    Q_INVOKABLE RpcCall *call(QString method, QJsonArray args = QJsonArray());
+
+    MessageTapList messageTaps() const;
+    void addMessageTap(std::shared_ptr<MessageTap> tap);
+    void removeMessageTap(std::shared_ptr<MessageTap> tap);
+
+    LogSink *effectiveLogSink() const { return m_effectiveLogSink; }
+    void startDetached();
+
 private Q_SLOTS:
     void post(QJsonValue value);
     void onStatus(ScriptInstance::Status status);
     void onSpawnComplete(int pid);
     void onResumeComplete();
+    void onTiming(QString stage, double milliseconds);
+    void onInterrupted(bool interrupted);
     void onError(QString message);
     void onMessage(QJsonObject object, QVariant data);
+    void onRpcReply(int id, QJsonArray reply, QVariant data);
+    void onReloaded(QList<int> abortedRpcCalls);
+    void updateLogSink();
 
 Q_SIGNALS:
     void statusChanged(Status newStatus);
+    void reloaded();
     void pidChanged(int newPid);
     void processStateChanged(ProcessState newState);
+    void interruptedChanged(bool newInterrupted);
+    void logSinkChanged(LogSink *newLogSink);
+    void timingsChanged(QVariantMap newTimings);
     void error(QString message);
     void message(QJsonObject object, QVariant data);
     void resumeProcessRequest();
@@ -131,12 +240,27 @@ Q_SIGNALS:
     void send(QJsonValue value);
     void enableDebuggerRequest(quint16 port);
     void disableDebuggerRequest();
+    void attachLogSinkRequest(LogSink *sink);
+    void attachMessageTapsRequest();
+    void rpcCallRequest(int id, QJsonValue request);
+    void abandonRpcCallRequest(int id);
+    void reloadRequest();
 
 private:
     Status m_status;
     Device *m_device;
     int m_pid;
     ProcessState m_processState;
+    bool m_autoResume;
+    bool m_interrupted;
+    QVariantMap m_timings;
+    QPointer<LogSink> m_logSink;
+    QPointer<LogSink> m_effectiveLogSink;
+    MessageTapList m_messageTaps;
+    int m_nextRpcId;
+    QHash<int, QPointer<RpcCall>> m_rpcCalls;
+
+    void rejectRpcCalls(QString message);
 
     friend class Device;
     friend class Script;
@@ -0,0 +1,131 @@
+#include "scriptinstancelistmodel.h"
+
+#include "device.h"
+#include "script.h"
+
+static const int ScriptInstanceObjectRole = Qt::UserRole + 0;
+static const int ScriptInstanceStatusRole = Qt::UserRole + 1;
+static const int ScriptInstancePidRole = Qt::UserRole + 2;
+static const int ScriptInstanceProcessStateRole = Qt::UserRole + 3;
+static const int ScriptInstanceDeviceRole = Qt::UserRole + 4;
+
+ScriptInstanceListModel::ScriptInstanceListModel(Script *parent) :
+    QAbstractListModel(parent)
+{
+}
+
+ScriptInstance *ScriptInstanceListModel::get(int index) const
+{
+    if (index < 0 || index >= m_instances.size())
+        return nullptr;
+
+    return m_instances[index];
+}
+
+QHash<int, QByteArray> ScriptInstanceListModel::roleNames() const
+{
+    QHash<int, QByteArray> r;
+    r[Qt::DisplayRole] = "display";
+    r[ScriptInstanceObjectRole] = "instance";
+    r[ScriptInstanceStatusRole] = "status";
+    r[ScriptInstancePidRole] = "pid";
+    r[ScriptInstanceProcessStateRole] = "processState";
+    r[ScriptInstanceDeviceRole] = "device";
+    return r;
+}
+
+int ScriptInstanceListModel::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+
+    return m_instances.size();
+}
+
+QVariant ScriptInstanceListModel::data(const QModelIndex &index, int role) const
+{
+    auto instance = m_instances[index.row()];
+    switch (role) {
+    case Qt::DisplayRole:
+        return QVariant(QString::number(instance->pid()));
+    case ScriptInstanceObjectRole:
+        return QVariant::fromValue(instance);
+    case ScriptInstanceStatusRole:
+        return QVariant::fromValue(instance->status());
+    case ScriptInstancePidRole:
+        return QVariant(instance->pid());
+    case ScriptInstanceProcessStateRole:
+        return QVariant::fromValue(instance->processState());
+    case ScriptInstanceDeviceRole:
+        return QVariant::fromValue(instance->device());
+    default:
+        return QVariant();
+    }
+}
+
+void ScriptInstanceListModel::add(ScriptInstance *instance)
+{
+    auto rowIndex = m_instances.size();
+    beginInsertRows(QModelIndex(), rowIndex, rowIndex);
+    m_instances.append(instance);
+    m_rows[instance] = rowIndex;
+    endInsertRows();
+    Q_EMIT countChanged(m_instances.count());
+
+    connect(instance, &ScriptInstance::statusChanged, this, [=] () {
+        notifyRowChanged(instance, ScriptInstanceStatusRole);
+    });
+    connect(instance, &ScriptInstance::pidChanged, this, [=] () {
+        notifyRowChanged(instance, ScriptInstancePidRole);
+    });
+    connect(instance, &ScriptInstance::processStateChanged, this, [=] () {
+        notifyRowChanged(instance, ScriptInstanceProcessStateRole);
+    });
+}
+
+int ScriptInstanceListModel::remove(ScriptInstance *instance)
+{
+    auto rowIndex = m_rows.value(instance, -1);
+    if (rowIndex == -1)
+        return -1;
+
+    disconnect(instance, nullptr, this, nullptr);
+
+    beginRemoveRows(QModelIndex(), rowIndex, rowIndex);
+    m_instances.removeAt(rowIndex);
+    m_rows.remove(instance);
+    for (auto i = rowIndex; i != m_instances.size(); i++)
+        m_rows[m_instances[i]] = i;
+    endRemoveRows();
+    Q_EMIT countChanged(m_instances.count());
+
+    return rowIndex;
+}
+
+void ScriptInstanceListModel::removeAll(const QSet<ScriptInstance *> &instances)
+{
+    if (instances.isEmpty())
+        return;
+
+    beginResetModel();
+    for (ScriptInstance *instance : instances)
+        disconnect(instance, nullptr, this, nullptr);
+    m_instances.removeIf([&] (ScriptInstance *instance) { return instances.contains(instance); });
+    m_rows.clear();
+    for (auto i = 0; i != m_instances.size(); i++)
+        m_rows[m_instances[i]] = i;
+    endResetModel();
+    Q_EMIT countChanged(m_instances.count());
+}
+
+void ScriptInstanceListModel::notifyRowChanged(ScriptInstance *instance, int role)
+{
+    auto rowIndex = m_rows.value(instance, -1);
+    if (rowIndex == -1)
+        return;
+
+    auto modelIndex = index(rowIndex);
+    QList<int> roles { role };
+    if (role == ScriptInstancePidRole)
+        roles.append(Qt::DisplayRole);
+    Q_EMIT dataChanged(modelIndex, modelIndex, roles);
+}
@@ -0,0 +1,45 @@
+#ifndef FRIDAQML_SCRIPTINSTANCELISTMODEL_H
+#define FRIDAQML_SCRIPTINSTANCELISTMODEL_H
+
+#include <QAbstractListModel>
+#include <QQmlEngine>
+#include <QSet>
+
+Q_MOC_INCLUDE("script.h")
+class Script;
+class ScriptInstance;
+
+class ScriptInstanceListModel : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(ScriptInstanceListModel)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    QML_ELEMENT
+    QML_UNCREATABLE("ScriptInstanceListModel objects cannot be instantiated from Qml");
+
+public:
+    explicit ScriptInstanceListModel(Script *parent);
+
+    int count() const { return m_instances.size(); }
+    Q_INVOKABLE ScriptInstance *get(int index) const;
+
+    QHash<int, QByteArray> roleNames() const override;
+    int rowCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+
+Q_SIGNALS:
+    void countChanged(int newCount);
+
+private:
+    void add(ScriptInstance *instance);
+    int remove(ScriptInstance *instance);
+    void removeAll(const QSet<ScriptInstance *> &instances);
+    void notifyRowChanged(ScriptInstance *instance, int role);
+
+    QList<ScriptInstance *> m_instances;
+    QHash<ScriptInstance *, int> m_rows;
+
+    friend class Script;
+};
+
+#endif
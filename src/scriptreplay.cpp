@@ -0,0 +1,255 @@
+#include <frida-core.h>
+
+#include "scriptreplay.h"
+
+#include "logsink.h"
+#include "maincontext.h"
+#include "script.h"
+#include "stats.h"
+
+// Records delivered per main loop iteration when there is no pacing to wait
+// for, so stopping a replay at max speed is still prompt.
+static const int ReplayBatchSize = 512;
+
+ScriptReplay::ScriptReplay(QObject *parent) :
+    QObject(parent),
+    m_speed(1.0),
+    m_active(false),
+    m_status(Status::Idle),
+    m_delivered(0),
+    m_generation(0),
+    m_playbackSpeed(1.0),
+    m_startTime(0),
+    m_hasRecord(false)
+{
+    m_progressTimer.setInterval(250);
+    connect(&m_progressTimer, &QTimer::timeout, this, &ScriptReplay::updateDelivered);
+}
+
+ScriptReplay::~ScriptReplay()
+{
+    stop();
+}
+
+void ScriptReplay::setScript(Script *script)
+{
+    if (script == m_script)
+        return;
+
+    m_script = script;
+    Q_EMIT scriptChanged(script);
+
+    if (m_active) {
+        stop();
+        start();
+    }
+}
+
+void ScriptReplay::setFilePath(QString filePath)
+{
+    if (filePath == m_filePath)
+        return;
+
+    m_filePath = filePath;
+    Q_EMIT filePathChanged(filePath);
+
+    if (m_active) {
+        stop();
+        start();
+    }
+}
+
+void ScriptReplay::setSpeed(double speed)
+{
+    if (speed == m_speed || speed < 0)
+        return;
+
+    m_speed = speed;
+    Q_EMIT speedChanged(speed);
+}
+
+void ScriptReplay::setActive(bool active)
+{
+    if (active == m_active)
+        return;
+
+    m_active = active;
+    if (active)
+        start();
+    else
+        stop();
+
+    Q_EMIT activeChanged(active);
+}
+
+void ScriptReplay::start()
+{
+    if (m_script.isNull() || m_filePath.isEmpty())
+        return;
+
+    std::unique_ptr<MessageRecordingReader> reader(new MessageRecordingReader(m_filePath));
+    QString errorMessage;
+    if (!reader->open(&errorMessage)) {
+        updateStatus(Status::Error);
+        Q_EMIT error(errorMessage);
+        return;
+    }
+
+    // Stands in for a live instance: messages reach it through the same
+    // dispatcher, queue and decoding as they would from an agent.
+    auto instance = m_script->bindDetached();
+    connect(instance, &ScriptInstance::stopRequest, this, [this] () { setActive(false); });
+    m_instance = instance;
+    Q_EMIT instanceChanged(instance);
+
+    auto logSink = instance->effectiveLogSink();
+    m_route = MessageRoute();
+    m_route.wrapper = instance;
+    m_route.logBuffer = (logSink != nullptr) ? logSink->buffer() : std::shared_ptr<LogBuffer>();
+    m_route.taps = instance->messageTaps();
+    m_route.cborPayloads = m_script->encoding() == Script::Encoding::Cbor;
+    if (m_script->offloadMessages())
+        m_messageQueue = std::make_shared<MessageQueue>();
+
+    m_reader = std::move(reader);
+    m_generation++;
+    m_playbackSpeed = m_speed;
+    m_hasRecord = false;
+    m_deliveredCount.storeRelaxed(0);
+    updateDelivered();
+
+    m_worker.reset(MainContext::createWorker("frida-qml-replay"));
+    m_worker->schedule([this] () {
+        m_startTime = g_get_monotonic_time();
+        pump();
+    });
+
+    m_progressTimer.start();
+    updateStatus(Status::Playing);
+}
+
+void ScriptReplay::stop()
+{
+    m_progressTimer.stop();
+
+    // Joins the worker, so nothing below races with pump(). A finish it
+    // already queued is for a run that no longer exists.
+    m_worker.reset();
+    m_generation++;
+    m_reader.reset();
+    if (m_messageQueue != nullptr) {
+        m_messageQueue->close();
+        m_messageQueue.reset();
+    }
+    m_route = MessageRoute();
+
+    if (!m_instance.isNull()) {
+        auto instance = m_instance.data();
+        m_instance = nullptr;
+        disconnect(instance, &ScriptInstance::stopRequest, this, nullptr);
+        instance->stop();
+        if (!m_script.isNull())
+            m_script->unbindDetached(instance);
+        Q_EMIT instanceChanged(nullptr);
+    }
+
+    updateStatus(Status::Idle);
+}
+
+void ScriptReplay::updateStatus(Status status)
+{
+    if (status == m_status)
+        return;
+
+    m_status = status;
+    Q_EMIT statusChanged(status);
+}
+
+void ScriptReplay::pump()
+{
+    for (int i = 0; i != ReplayBatchSize; i++) {
+        if (!m_hasRecord) {
+            if (!m_reader->next(&m_record)) {
+                invokeQueued(this, "onFinished",
+                    Q_ARG(int, m_generation),
+                    Q_ARG(QString, m_reader->errorString()));
+                return;
+            }
+            m_hasRecord = true;
+        }
+
+        if (m_playbackSpeed > 0) {
+            auto due = m_startTime + static_cast<qint64>(m_record.timestamp / m_playbackSpeed);
+            auto delay = due - g_get_monotonic_time();
+            if (delay >= 1000) {
+                schedulePump(static_cast<guint>(delay / 1000));
+                return;
+            }
+        }
+
+        deliver(m_record);
+        m_hasRecord = false;
+    }
+
+    schedulePump(0);
+}
+
+void ScriptReplay::deliver(const MessageRecord &record)
+{
+    GBytes *data = record.hasData ? g_bytes_new(record.data.constData(), record.data.size()) : nullptr;
+
+    m_route.pid = record.pid;
+    if (m_messageQueue != nullptr)
+        m_messageQueue->push(m_route, record.message.constData(), data);
+    else
+        MessageDispatcher::deliver(m_route, record.message, data);
+
+    if (data != nullptr)
+        g_bytes_unref(data);
+
+    m_deliveredCount.fetchAndAddRelaxed(1);
+}
+
+void ScriptReplay::schedulePump(guint delay)
+{
+    auto source = (delay != 0) ? g_timeout_source_new(delay) : g_idle_source_new();
+    g_source_set_callback(source, onPumpWrapper, this, nullptr);
+    g_source_attach(source, m_worker->handle());
+    g_source_unref(source);
+}
+
+gboolean ScriptReplay::onPumpWrapper(gpointer data)
+{
+    static_cast<ScriptReplay *>(data)->pump();
+    return FALSE;
+}
+
+void ScriptReplay::onFinished(int generation, QString errorMessage)
+{
+    if (generation != m_generation || m_status != Status::Playing)
+        return;
+
+    m_progressTimer.stop();
+    m_worker.reset();
+    m_reader.reset();
+    updateDelivered();
+
+    if (!errorMessage.isEmpty()) {
+        updateStatus(Status::Error);
+        Q_EMIT error(errorMessage);
+        return;
+    }
+
+    updateStatus(Status::Finished);
+    Q_EMIT finished();
+}
+
+void ScriptReplay::updateDelivered()
+{
+    auto delivered = m_deliveredCount.loadRelaxed();
+    if (delivered == m_delivered)
+        return;
+
+    m_delivered = delivered;
+    Q_EMIT deliveredChanged(delivered);
+}
@@ -0,0 +1,96 @@
+#ifndef FRIDAQML_SCRIPTREPLAY_H
+#define FRIDAQML_SCRIPTREPLAY_H
+
+#include "messagedispatcher.h"
+#include "messagerecorder.h"
+
+#include <QAtomicInteger>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QTimer>
+
+Q_MOC_INCLUDE("script.h")
+class MainContext;
+class Script;
+class ScriptInstance;
+
+class ScriptReplay : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(ScriptReplay)
+    Q_PROPERTY(Script *script READ script WRITE setScript NOTIFY scriptChanged)
+    Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
+    Q_PROPERTY(double speed READ speed WRITE setSpeed NOTIFY speedChanged)
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(ScriptInstance *instance READ instance NOTIFY instanceChanged)
+    Q_PROPERTY(int delivered READ delivered NOTIFY deliveredChanged)
+    QML_ELEMENT
+
+public:
+    enum class Status { Idle, Playing, Finished, Error };
+    Q_ENUM(Status)
+
+    explicit ScriptReplay(QObject *parent = nullptr);
+    ~ScriptReplay();
+
+    Script *script() const { return m_script; }
+    void setScript(Script *script);
+    QString filePath() const { return m_filePath; }
+    void setFilePath(QString filePath);
+    double speed() const { return m_speed; }
+    void setSpeed(double speed);
+    bool isActive() const { return m_active; }
+    void setActive(bool active);
+    Status status() const { return m_status; }
+    ScriptInstance *instance() const { return m_instance; }
+    int delivered() const { return m_delivered; }
+
+Q_SIGNALS:
+    void scriptChanged(Script *newScript);
+    void filePathChanged(QString newFilePath);
+    void speedChanged(double newSpeed);
+    void activeChanged(bool newActive);
+    void statusChanged(Status newStatus);
+    void instanceChanged(ScriptInstance *newInstance);
+    void deliveredChanged(int newDelivered);
+    void finished();
+    void error(QString message);
+
+private:
+    void start();
+    void stop();
+    void updateStatus(Status status);
+
+    void pump();
+    void deliver(const MessageRecord &record);
+    void schedulePump(guint delay);
+    static gboolean onPumpWrapper(gpointer data);
+
+private Q_SLOTS:
+    void onFinished(int generation, QString errorMessage);
+    void updateDelivered();
+
+private:
+    QPointer<Script> m_script;
+    QString m_filePath;
+    double m_speed;
+    bool m_active;
+    Status m_status;
+    QPointer<ScriptInstance> m_instance;
+    int m_delivered;
+    int m_generation;
+    QTimer m_progressTimer;
+    QScopedPointer<MainContext> m_worker;
+
+    std::unique_ptr<MessageRecordingReader> m_reader;
+    MessageRoute m_route;
+    std::shared_ptr<MessageQueue> m_messageQueue;
+    double m_playbackSpeed;
+    qint64 m_startTime;
+    MessageRecord m_record;
+    bool m_hasRecord;
+    QAtomicInt m_deliveredCount;
+};
+
+#endif
@@ -0,0 +1,536 @@
+#include <frida-core.h>
+
+#include "spawngate.h"
+
+#include "device.h"
+#include "maincontext.h"
+#include "script.h"
+#include "stats.h"
+
+static const int SpawnPidRole = Qt::UserRole + 0;
+static const int SpawnIdentifierRole = Qt::UserRole + 1;
+static const int SpawnStateRole = Qt::UserRole + 2;
+
+struct SpawnGateRequest
+{
+    SpawnGate *gate;
+    FridaDevice *handle;
+    int pid;
+};
+
+SpawnGate::SpawnGate(QObject *parent) :
+    QAbstractListModel(parent),
+    m_active(false),
+    m_autoResume(true),
+    m_maxConcurrent(4),
+    m_childGating(false),
+    m_inFlight(0),
+    m_handle(nullptr),
+    m_mainContext(new MainContext(frida_get_main_context()))
+{
+}
+
+void SpawnGate::dispose()
+{
+    for (SpawnGateRequest *request : std::as_const(m_requests))
+        request->gate = nullptr;
+    m_requests.clear();
+
+    performDisable();
+}
+
+SpawnGate::~SpawnGate()
+{
+    m_mainContext->perform([this] () { dispose(); });
+}
+
+void SpawnGate::setDevice(Device *device)
+{
+    if (device == m_device)
+        return;
+
+    m_device = device;
+    Q_EMIT deviceChanged(device);
+
+    clear();
+    updateGating();
+}
+
+void SpawnGate::setActive(bool active)
+{
+    if (active == m_active)
+        return;
+
+    m_active = active;
+    Q_EMIT activeChanged(active);
+
+    updateGating();
+}
+
+void SpawnGate::setScript(Script *script)
+{
+    if (script == m_script)
+        return;
+
+    m_script = script;
+    Q_EMIT scriptChanged(script);
+
+    processQueue();
+}
+
+void SpawnGate::setAutoResume(bool autoResume)
+{
+    if (autoResume == m_autoResume)
+        return;
+
+    m_autoResume = autoResume;
+    Q_EMIT autoResumeChanged(autoResume);
+
+    processQueue();
+}
+
+void SpawnGate::setMaxConcurrent(int maxConcurrent)
+{
+    if (maxConcurrent == m_maxConcurrent || maxConcurrent < 1)
+        return;
+
+    m_maxConcurrent = maxConcurrent;
+    Q_EMIT maxConcurrentChanged(maxConcurrent);
+
+    processQueue();
+}
+
+void SpawnGate::setChildGating(bool childGating)
+{
+    if (childGating == m_childGating)
+        return;
+
+    m_childGating = childGating;
+    Q_EMIT childGatingChanged(childGating);
+
+    updateGating();
+}
+
+QVariantMap SpawnGate::get(int index) const
+{
+    if (index < 0 || index >= m_spawns.size())
+        return QVariantMap();
+
+    const PendingSpawn &spawn = m_spawns[index];
+    QVariantMap result;
+    result["pid"] = spawn.pid;
+    result["identifier"] = spawn.identifier;
+    return result;
+}
+
+void SpawnGate::resume(int pid)
+{
+    auto index = indexOf(pid);
+    if (index == -1 || m_spawns[index].state == State::Resuming)
+        return;
+
+    resumeSpawn(index);
+}
+
+QHash<int, QByteArray> SpawnGate::roleNames() const
+{
+    QHash<int, QByteArray> r;
+    r[Qt::DisplayRole] = "display";
+    r[SpawnPidRole] = "pid";
+    r[SpawnIdentifierRole] = "identifier";
+    r[SpawnStateRole] = "state";
+    return r;
+}
+
+int SpawnGate::rowCount(const QModelIndex &parent) const
+{
+    Q_UNUSED(parent);
+
+    return m_spawns.size();
+}
+
+QVariant SpawnGate::data(const QModelIndex &index, int role) const
+{
+    const PendingSpawn &spawn = m_spawns[index.row()];
+    switch (role) {
+    case SpawnPidRole:
+        return QVariant(spawn.pid);
+    case SpawnIdentifierRole:
+        return QVariant(spawn.identifier);
+    case SpawnStateRole:
+        switch (spawn.state) {
+        case State::Queued:
+            return QVariant("queued");
+        case State::Injecting:
+            return QVariant("injecting");
+        case State::Injected:
+            return QVariant("injected");
+        case State::Resuming:
+            return QVariant("resuming");
+        case State::Failed:
+            return QVariant("failed");
+        }
+        return QVariant();
+    case Qt::DisplayRole:
+        return QVariant(spawn.identifier.isEmpty() ? QString::number(spawn.pid) : spawn.identifier);
+    default:
+        return QVariant();
+    }
+}
+
+void SpawnGate::updateGating()
+{
+    FridaDevice *handle = nullptr;
+    if (m_active && !m_device.isNull()) {
+        handle = m_device->handle();
+        g_object_ref(handle);
+    }
+    auto childGating = m_childGating;
+
+    m_mainContext->schedule([=] () {
+        performDisable();
+        if (handle != nullptr)
+            performEnable(handle, childGating);
+    });
+}
+
+void SpawnGate::clear()
+{
+    m_inFlight = 0;
+    m_queue.clear();
+
+    if (m_spawns.isEmpty())
+        return;
+
+    beginRemoveRows(QModelIndex(), 0, m_spawns.size() - 1);
+    m_spawns.clear();
+    m_rows.clear();
+    endRemoveRows();
+    Q_EMIT countChanged(0);
+}
+
+int SpawnGate::indexOf(int pid) const
+{
+    return m_rows.value(pid, -1);
+}
+
+void SpawnGate::reindex(int from)
+{
+    auto size = m_spawns.size();
+    for (int i = from; i != size; i++)
+        m_rows[m_spawns[i].pid] = i;
+}
+
+void SpawnGate::processQueue()
+{
+    if (m_script.isNull() && !m_autoResume)
+        return;
+
+    // Spawns resumed by hand or gone meanwhile are still in the queue, and
+    // are skipped as they come up.
+    while (m_inFlight < m_maxConcurrent && !m_queue.isEmpty()) {
+        auto index = indexOf(m_queue.dequeue());
+        if (index != -1 && m_spawns[index].state == State::Queued)
+            dispatch(index);
+    }
+}
+
+void SpawnGate::dispatch(int index)
+{
+    PendingSpawn &spawn = m_spawns[index];
+    spawn.throttled = true;
+    m_inFlight++;
+
+    // Injecting needs a session of its own in every process, which is why
+    // only as many as maxConcurrent are attached to at a time.
+    ScriptInstance *instance = nullptr;
+    if (!m_script.isNull() && !m_device.isNull())
+        instance = m_device->inject(m_script, spawn.pid);
+
+    if (instance == nullptr) {
+        resumeSpawn(index);
+        return;
+    }
+
+    // Its children then show up here too, held until they've been handled
+    // just like any other spawn.
+    if (m_childGating)
+        m_device->enableChildGating(spawn.pid);
+
+    spawn.state = State::Injecting;
+    Q_EMIT dataChanged(this->index(index), this->index(index), { SpawnStateRole });
+    Q_EMIT instanceCreated(instance);
+
+    auto pid = spawn.pid;
+    auto onStatusChanged = std::make_shared<QMetaObject::Connection>();
+    *onStatusChanged = connect(instance, &ScriptInstance::statusChanged, this, [=] (ScriptInstance::Status status) {
+        if (status < ScriptInstance::Status::Started)
+            return;
+        QObject::disconnect(*onStatusChanged);
+
+        auto i = indexOf(pid);
+        if (i == -1 || m_spawns[i].state != State::Injecting)
+            return;
+
+        // A failed script must not leave the process suspended forever.
+        if (m_autoResume || status != ScriptInstance::Status::Started) {
+            resumeSpawn(i);
+        } else {
+            m_spawns[i].state = State::Injected;
+            Q_EMIT dataChanged(this->index(i), this->index(i), { SpawnStateRole });
+            release(i);
+        }
+    });
+}
+
+void SpawnGate::resumeSpawn(int index)
+{
+    PendingSpawn &spawn = m_spawns[index];
+
+    // Nothing will ever resume it now, so stop counting it as in flight.
+    if (m_device.isNull()) {
+        spawn.state = State::Failed;
+        Q_EMIT dataChanged(this->index(index), this->index(index), { SpawnStateRole });
+        Q_EMIT error(QString("Failed to resume %1: device is gone").arg(spawn.pid));
+        release(index);
+        return;
+    }
+
+    spawn.state = State::Resuming;
+    Q_EMIT dataChanged(this->index(index), this->index(index), { SpawnStateRole });
+
+    auto handle = m_device->handle();
+    g_object_ref(handle);
+    auto pid = spawn.pid;
+    m_mainContext->schedule([=] () { performResume(handle, pid); });
+}
+
+void SpawnGate::release(int index)
+{
+    PendingSpawn &spawn = m_spawns[index];
+    if (!spawn.throttled)
+        return;
+
+    spawn.throttled = false;
+    m_inFlight--;
+    processQueue();
+}
+
+void SpawnGate::performEnable(FridaDevice *handle, bool childGating)
+{
+    m_handle = handle;
+
+    g_signal_connect_swapped(handle, "spawn-added", G_CALLBACK(onSpawnAddedWrapper), this);
+    g_signal_connect_swapped(handle, "spawn-removed", G_CALLBACK(onSpawnRemovedWrapper), this);
+    if (childGating) {
+        g_signal_connect_swapped(handle, "child-added", G_CALLBACK(onChildAddedWrapper), this);
+        g_signal_connect_swapped(handle, "child-removed", G_CALLBACK(onChildRemovedWrapper), this);
+    }
+
+    frida_device_enable_spawn_gating(handle, nullptr, onEnableReadyWrapper, createRequest(handle, -1));
+}
+
+void SpawnGate::performDisable()
+{
+    if (m_handle == nullptr)
+        return;
+
+    g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onSpawnAddedWrapper), this);
+    g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onSpawnRemovedWrapper), this);
+    g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onChildAddedWrapper), this);
+    g_signal_handlers_disconnect_by_func(m_handle, GSIZE_TO_POINTER(onChildRemovedWrapper), this);
+
+    frida_device_disable_spawn_gating(m_handle, nullptr, nullptr, nullptr);
+
+    g_object_unref(m_handle);
+    m_handle = nullptr;
+}
+
+SpawnGateRequest *SpawnGate::createRequest(FridaDevice *handle, int pid)
+{
+    auto request = g_slice_new(SpawnGateRequest);
+    request->gate = this;
+    request->handle = handle;
+    request->pid = pid;
+    g_object_ref(handle);
+    m_requests.insert(request);
+    return request;
+}
+
+void SpawnGate::finishRequest(SpawnGateRequest *request)
+{
+    if (request->gate != nullptr)
+        request->gate->m_requests.remove(request);
+    g_object_unref(request->handle);
+    g_slice_free(SpawnGateRequest, request);
+}
+
+void SpawnGate::onEnableReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<SpawnGateRequest *>(data);
+    if (request->gate != nullptr)
+        request->gate->onEnableReady(request, res);
+    finishRequest(request);
+}
+
+void SpawnGate::onEnableReady(SpawnGateRequest *request, GAsyncResult *res)
+{
+    GError *error = nullptr;
+    frida_device_enable_spawn_gating_finish(request->handle, res, &error);
+
+    if (error != nullptr) {
+        auto message = QString("Failed to enable spawn gating: ").append(QString::fromUtf8(error->message));
+        invokeQueued(this, "onError",
+            Q_ARG(QString, message));
+        g_clear_error(&error);
+        return;
+    }
+
+    // Pick up processes that were gated before we started listening.
+    frida_device_enumerate_pending_spawn(request->handle, nullptr, onEnumerateReadyWrapper,
+        createRequest(request->handle, -1));
+}
+
+void SpawnGate::onEnumerateReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<SpawnGateRequest *>(data);
+    if (request->gate != nullptr)
+        request->gate->onEnumerateReady(request, res);
+    finishRequest(request);
+}
+
+void SpawnGate::onEnumerateReady(SpawnGateRequest *request, GAsyncResult *res)
+{
+    GError *error = nullptr;
+    auto spawns = frida_device_enumerate_pending_spawn_finish(request->handle, res, &error);
+
+    if (error != nullptr) {
+        auto message = QString("Failed to enumerate pending spawns: ").append(QString::fromUtf8(error->message));
+        invokeQueued(this, "onError",
+            Q_ARG(QString, message));
+        g_clear_error(&error);
+        return;
+    }
+
+    const int size = frida_spawn_list_size(spawns);
+    for (int i = 0; i != size; i++) {
+        auto spawn = frida_spawn_list_get(spawns, i);
+        onSpawnAddedWrapper(this, spawn);
+        g_object_unref(spawn);
+    }
+
+    g_object_unref(spawns);
+}
+
+void SpawnGate::onSpawnAddedWrapper(SpawnGate *self, FridaSpawn *spawn)
+{
+    auto identifier = frida_spawn_get_identifier(spawn);
+    invokeQueued(self, "onSpawnAdded",
+        Q_ARG(int, frida_spawn_get_pid(spawn)),
+        Q_ARG(QString, (identifier != nullptr) ? QString::fromUtf8(identifier) : QString()));
+}
+
+void SpawnGate::onSpawnRemovedWrapper(SpawnGate *self, FridaSpawn *spawn)
+{
+    invokeQueued(self, "onSpawnRemoved",
+        Q_ARG(int, frida_spawn_get_pid(spawn)));
+}
+
+void SpawnGate::onChildAddedWrapper(SpawnGate *self, FridaChild *child)
+{
+    auto identifier = frida_child_get_identifier(child);
+    invokeQueued(self, "onSpawnAdded",
+        Q_ARG(int, frida_child_get_pid(child)),
+        Q_ARG(QString, (identifier != nullptr) ? QString::fromUtf8(identifier) : QString()));
+}
+
+void SpawnGate::onChildRemovedWrapper(SpawnGate *self, FridaChild *child)
+{
+    invokeQueued(self, "onSpawnRemoved",
+        Q_ARG(int, frida_child_get_pid(child)));
+}
+
+void SpawnGate::performResume(FridaDevice *handle, int pid)
+{
+    frida_device_resume(handle, pid, nullptr, onResumeReadyWrapper, createRequest(handle, pid));
+    g_object_unref(handle);
+}
+
+void SpawnGate::onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<SpawnGateRequest *>(data);
+    if (request->gate != nullptr)
+        request->gate->onResumeReady(request, res);
+    finishRequest(request);
+}
+
+void SpawnGate::onResumeReady(SpawnGateRequest *request, GAsyncResult *res)
+{
+    GError *error = nullptr;
+    frida_device_resume_finish(request->handle, res, &error);
+
+    if (error != nullptr) {
+        auto message = QString("Failed to resume %1: ").arg(request->pid).append(QString::fromUtf8(error->message));
+        invokeQueued(this, "onError",
+            Q_ARG(QString, message));
+        g_clear_error(&error);
+    }
+
+    invokeQueued(this, "onResumeComplete",
+        Q_ARG(int, request->pid));
+}
+
+void SpawnGate::onSpawnAdded(int pid, QString identifier)
+{
+    if (!m_active || indexOf(pid) != -1)
+        return;
+
+    auto index = m_spawns.size();
+    beginInsertRows(QModelIndex(), index, index);
+    m_spawns.append({ pid, identifier, State::Queued, false });
+    m_rows[pid] = index;
+    endInsertRows();
+    m_queue.enqueue(pid);
+    Q_EMIT countChanged(m_spawns.size());
+
+    Q_EMIT spawnAdded(pid, identifier);
+
+    processQueue();
+}
+
+void SpawnGate::onSpawnRemoved(int pid)
+{
+    onResumeComplete(pid);
+}
+
+void SpawnGate::onResumeComplete(int pid)
+{
+    auto index = indexOf(pid);
+    if (index == -1)
+        return;
+
+    auto throttled = m_spawns[index].throttled;
+
+    beginRemoveRows(QModelIndex(), index, index);
+    m_spawns.removeAt(index);
+    m_rows.remove(pid);
+    reindex(index);
+    endRemoveRows();
+    Q_EMIT countChanged(m_spawns.size());
+
+    if (throttled) {
+        m_inFlight--;
+        processQueue();
+    }
+}
+
+void SpawnGate::onError(QString message)
+{
+    Q_EMIT error(message);
+}
@@ -0,0 +1,133 @@
+#ifndef FRIDAQML_SPAWNGATE_H
+#define FRIDAQML_SPAWNGATE_H
+
+#include "fridafwd.h"
+
+#include <QAbstractListModel>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QQueue>
+#include <QSet>
+
+Q_MOC_INCLUDE("device.h")
+Q_MOC_INCLUDE("script.h")
+class Device;
+class MainContext;
+class Script;
+class ScriptInstance;
+struct SpawnGateRequest;
+
+class SpawnGate : public QAbstractListModel
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(SpawnGate)
+    Q_PROPERTY(int count READ count NOTIFY countChanged)
+    Q_PROPERTY(Device *device READ device WRITE setDevice NOTIFY deviceChanged)
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_PROPERTY(Script *script READ script WRITE setScript NOTIFY scriptChanged)
+    Q_PROPERTY(bool autoResume READ autoResume WRITE setAutoResume NOTIFY autoResumeChanged)
+    Q_PROPERTY(int maxConcurrent READ maxConcurrent WRITE setMaxConcurrent NOTIFY maxConcurrentChanged)
+    Q_PROPERTY(bool childGating READ childGating WRITE setChildGating NOTIFY childGatingChanged)
+    QML_ELEMENT
+
+public:
+    explicit SpawnGate(QObject *parent = nullptr);
+private:
+    void dispose();
+public:
+    ~SpawnGate();
+
+    int count() const { return m_spawns.size(); }
+    Device *device() const { return m_device; }
+    void setDevice(Device *device);
+    bool isActive() const { return m_active; }
+    void setActive(bool active);
+    Script *script() const { return m_script; }
+    void setScript(Script *script);
+    bool autoResume() const { return m_autoResume; }
+    void setAutoResume(bool autoResume);
+    int maxConcurrent() const { return m_maxConcurrent; }
+    void setMaxConcurrent(int maxConcurrent);
+    bool childGating() const { return m_childGating; }
+    void setChildGating(bool childGating);
+
+    Q_INVOKABLE QVariantMap get(int index) const;
+    Q_INVOKABLE void resume(int pid);
+
+    QHash<int, QByteArray> roleNames() const override;
+    int rowCount(const QModelIndex &parent) const override;
+    QVariant data(const QModelIndex &index, int role) const override;
+
+Q_SIGNALS:
+    void countChanged(int newCount);
+    void deviceChanged(Device *newDevice);
+    void activeChanged(bool newActive);
+    void scriptChanged(Script *newScript);
+    void autoResumeChanged(bool newAutoResume);
+    void maxConcurrentChanged(int newMaxConcurrent);
+    void childGatingChanged(bool newChildGating);
+    void spawnAdded(int pid, QString identifier);
+    void instanceCreated(ScriptInstance *instance);
+    void error(QString message);
+
+private:
+    enum class State { Queued, Injecting, Injected, Resuming, Failed };
+
+    struct PendingSpawn
+    {
+        int pid;
+        QString identifier;
+        State state;
+        bool throttled;
+    };
+
+    void updateGating();
+    void clear();
+    int indexOf(int pid) const;
+    void reindex(int from);
+    void processQueue();
+    void dispatch(int index);
+    void resumeSpawn(int index);
+    void release(int index);
+
+    void performEnable(FridaDevice *handle, bool childGating);
+    void performDisable();
+    SpawnGateRequest *createRequest(FridaDevice *handle, int pid);
+    static void onEnableReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onEnableReady(SpawnGateRequest *request, GAsyncResult *res);
+    static void onEnumerateReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onEnumerateReady(SpawnGateRequest *request, GAsyncResult *res);
+    static void onSpawnAddedWrapper(SpawnGate *self, FridaSpawn *spawn);
+    static void onSpawnRemovedWrapper(SpawnGate *self, FridaSpawn *spawn);
+    static void onChildAddedWrapper(SpawnGate *self, FridaChild *child);
+    static void onChildRemovedWrapper(SpawnGate *self, FridaChild *child);
+    void performResume(FridaDevice *handle, int pid);
+    static void onResumeReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onResumeReady(SpawnGateRequest *request, GAsyncResult *res);
+    static void finishRequest(SpawnGateRequest *request);
+
+private Q_SLOTS:
+    void onSpawnAdded(int pid, QString identifier);
+    void onSpawnRemoved(int pid);
+    void onResumeComplete(int pid);
+    void onError(QString message);
+
+private:
+    QPointer<Device> m_device;
+    bool m_active;
+    QPointer<Script> m_script;
+    bool m_autoResume;
+    int m_maxConcurrent;
+    bool m_childGating;
+    QList<PendingSpawn> m_spawns;
+    QHash<int, int> m_rows;
+    QQueue<int> m_queue;
+    int m_inFlight;
+
+    FridaDevice *m_handle;
+    QSet<SpawnGateRequest *> m_requests;
+
+    QScopedPointer<MainContext> m_mainContext;
+};
+
+#endif
@@ -7,7 +7,8 @@ static gchar **unparseStrv(QVector<QString> vector);
 
 SpawnOptions::SpawnOptions(QObject *parent) :
     QObject(parent),
-    m_handle(frida_spawn_options_new())
+    m_handle(frida_spawn_options_new()),
+    m_autoResume(false)
 {
 }
 
@@ -118,6 +119,14 @@ void SpawnOptions::unsetCwd()
     Q_EMIT hasCwdChanged(false);
 }
 
+void SpawnOptions::setAutoResume(bool autoResume)
+{
+    if (autoResume == m_autoResume)
+        return;
+    m_autoResume = autoResume;
+    Q_EMIT autoResumeChanged(autoResume);
+}
+
 static QVector<QString> parseStrv(gchar **strv, gint length)
 {
     QVector<QString> result(length);
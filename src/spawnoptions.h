@@ -19,6 +19,8 @@ class SpawnOptions : public QObject
     Q_PROPERTY(bool hasCwd READ hasCwd NOTIFY hasCwdChanged)
     Q_PROPERTY(QString cwd READ cwd WRITE setCwd NOTIFY cwdChanged)
 
+    Q_PROPERTY(bool autoResume READ autoResume WRITE setAutoResume NOTIFY autoResumeChanged)
+
     QML_ELEMENT
 
 public:
@@ -42,6 +44,9 @@ public:
     void setCwd(QString cwd);
     Q_INVOKABLE void unsetCwd();
 
+    bool autoResume() const { return m_autoResume; }
+    void setAutoResume(bool autoResume);
+
 Q_SIGNALS:
     void hasArgvChanged(bool newHasArgv);
     void argvChanged(QVector<QString> newArgv);
@@ -52,8 +57,11 @@ Q_SIGNALS:
     void hasCwdChanged(bool newHasCwd);
     void cwdChanged(QString newCwd);
 
+    void autoResumeChanged(bool newAutoResume);
+
 private:
     FridaSpawnOptions *m_handle;
+    bool m_autoResume;
 };
 
 #endif
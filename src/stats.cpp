@@ -0,0 +1,145 @@
+#include <frida-core.h>
+
+#include "stats.h"
+
+static const qint64 bucketLimits[HopStats::BucketCount - 1] = {
+    100, 250, 500, 1000, 2500, 5000, 10000, 25000, 50000, 100000, 250000
+};
+
+QAtomicInt HopStats::s_guiQueueTracked;
+
+HopStats *HopStats::fridaQueue()
+{
+    static HopStats stats;
+    return &stats;
+}
+
+HopStats *HopStats::guiQueue()
+{
+    static HopStats stats;
+    return &stats;
+}
+
+qint64 HopStats::enter()
+{
+    int depth = m_depth.fetchAndAddRelaxed(1) + 1;
+
+    int maxDepth = m_maxDepth.loadRelaxed();
+    while (depth > maxDepth && !m_maxDepth.testAndSetRelaxed(maxDepth, depth, maxDepth)) {
+    }
+
+    return g_get_monotonic_time();
+}
+
+void HopStats::leave(qint64 enqueueTime)
+{
+    qint64 wait = g_get_monotonic_time() - enqueueTime;
+
+    m_depth.fetchAndSubRelaxed(1);
+    m_count.fetchAndAddRelaxed(1);
+    m_totalWait.fetchAndAddRelaxed(wait);
+    m_buckets[bucketFor(wait)].fetchAndAddRelaxed(1);
+
+    qint64 maxWait = m_maxWait.loadRelaxed();
+    while (wait > maxWait && !m_maxWait.testAndSetRelaxed(maxWait, wait, maxWait)) {
+    }
+}
+
+void HopStats::cancel()
+{
+    m_depth.fetchAndSubRelaxed(1);
+}
+
+void HopStats::reset()
+{
+    // Depth tracks calls still in flight, so it carries over.
+    m_maxDepth.storeRelaxed(m_depth.loadRelaxed());
+    m_count.storeRelaxed(0);
+    m_totalWait.storeRelaxed(0);
+    m_maxWait.storeRelaxed(0);
+    for (auto &bucket : m_buckets)
+        bucket.storeRelaxed(0);
+}
+
+QVariantMap HopStats::snapshot() const
+{
+    quint64 count = m_count.loadRelaxed();
+
+    QVariantList histogram;
+    for (const auto &bucket : m_buckets)
+        histogram.append(static_cast<double>(bucket.loadRelaxed()));
+
+    return QVariantMap {
+        { "depth", m_depth.loadRelaxed() },
+        { "maxDepth", m_maxDepth.loadRelaxed() },
+        { "count", static_cast<double>(count) },
+        { "meanWait", (count != 0) ? m_totalWait.loadRelaxed() / 1000.0 / count : 0.0 },
+        { "maxWait", m_maxWait.loadRelaxed() / 1000.0 },
+        { "histogram", histogram },
+    };
+}
+
+QVariantList HopStats::bucketBounds()
+{
+    QVariantList bounds;
+    for (qint64 limit : bucketLimits)
+        bounds.append(limit / 1000.0);
+    return bounds;
+}
+
+int HopStats::bucketFor(qint64 wait)
+{
+    int i = 0;
+    while (i != BucketCount - 1 && wait >= bucketLimits[i])
+        i++;
+    return i;
+}
+
+Stats::Stats(QObject *parent) :
+    QObject(parent),
+    m_enabled(false),
+    m_updateInterval(1000)
+{
+    connect(&m_timer, &QTimer::timeout, this, &Stats::updated);
+}
+
+void Stats::setEnabled(bool enabled)
+{
+    if (enabled == m_enabled)
+        return;
+
+    m_enabled = enabled;
+    HopStats::setGuiQueueTracked(enabled);
+    updateTimer();
+
+    Q_EMIT enabledChanged(enabled);
+}
+
+void Stats::setUpdateInterval(int updateInterval)
+{
+    if (updateInterval == m_updateInterval)
+        return;
+
+    m_updateInterval = updateInterval;
+    updateTimer();
+
+    Q_EMIT updateIntervalChanged(updateInterval);
+}
+
+void Stats::updateTimer()
+{
+    if (m_enabled && m_updateInterval > 0) {
+        m_timer.setInterval(m_updateInterval);
+        m_timer.start();
+    } else {
+        m_timer.stop();
+    }
+}
+
+void Stats::reset()
+{
+    HopStats::fridaQueue()->reset();
+    HopStats::guiQueue()->reset();
+
+    Q_EMIT updated();
+}
@@ -0,0 +1,112 @@
+#ifndef FRIDAQML_STATS_H
+#define FRIDAQML_STATS_H
+
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QQmlEngine>
+#include <QTimer>
+#include <utility>
+
+class HopStats
+{
+public:
+    static const int BucketCount = 12;
+
+    // Calls scheduled onto frida's loops, and calls queued back to the GUI thread.
+    static HopStats *fridaQueue();
+    static HopStats *guiQueue();
+
+    // Measuring the GUI queue costs a second queued call per hop, so it
+    // only happens while a Stats consumer has asked for it.
+    static bool isGuiQueueTracked() { return s_guiQueueTracked.loadRelaxed() != 0; }
+    static void setGuiQueueTracked(bool tracked) { s_guiQueueTracked.storeRelaxed(tracked ? 1 : 0); }
+
+    qint64 enter();
+    void leave(qint64 enqueueTime);
+    void cancel();
+    void reset();
+    QVariantMap snapshot() const;
+
+    static QVariantList bucketBounds();
+
+private:
+    HopStats() = default;
+    Q_DISABLE_COPY_MOVE(HopStats)
+
+    static int bucketFor(qint64 wait);
+
+    static QAtomicInt s_guiQueueTracked;
+
+    QAtomicInt m_depth;
+    QAtomicInt m_maxDepth;
+    QAtomicInteger<quint64> m_count;
+    QAtomicInteger<quint64> m_totalWait;
+    QAtomicInteger<qint64> m_maxWait;
+    QAtomicInteger<quint64> m_buckets[BucketCount] = {};
+};
+
+// Drop-in for QMetaObject::invokeMethod(..., Qt::QueuedConnection, ...) on
+// objects living on the GUI thread. A marker queued right behind the call
+// is dispatched right after it, which is when the hop is accounted as done.
+template <typename... Args>
+inline bool invokeQueued(QObject *receiver, const char *member, Args &&...args)
+{
+    if (!HopStats::isGuiQueueTracked())
+        return QMetaObject::invokeMethod(receiver, member, Qt::QueuedConnection, std::forward<Args>(args)...);
+
+    auto stats = HopStats::guiQueue();
+    auto enqueueTime = stats->enter();
+
+    bool posted = QMetaObject::invokeMethod(receiver, member, Qt::QueuedConnection, std::forward<Args>(args)...);
+
+    auto app = QCoreApplication::instance();
+    if (!posted || app == nullptr)
+        stats->cancel();
+    else
+        QMetaObject::invokeMethod(app, [stats, enqueueTime] () { stats->leave(enqueueTime); }, Qt::QueuedConnection);
+
+    return posted;
+}
+
+// Waits are in milliseconds; histogram[i] counts the waits below
+// bucketBounds[i], with the last entry counting everything above. Nothing
+// is measured on the GUI queue, and updated() is not emitted, unless enabled.
+class Stats : public QObject
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(Stats)
+    Q_PROPERTY(QVariantMap fridaQueue READ fridaQueue NOTIFY updated)
+    Q_PROPERTY(QVariantMap guiQueue READ guiQueue NOTIFY updated)
+    Q_PROPERTY(QVariantList bucketBounds READ bucketBounds CONSTANT)
+    Q_PROPERTY(bool enabled READ isEnabled WRITE setEnabled NOTIFY enabledChanged)
+    Q_PROPERTY(int updateInterval READ updateInterval WRITE setUpdateInterval NOTIFY updateIntervalChanged)
+    QML_ELEMENT
+    QML_UNCREATABLE("Stats is available as Frida.stats")
+
+public:
+    explicit Stats(QObject *parent = nullptr);
+
+    QVariantMap fridaQueue() const { return HopStats::fridaQueue()->snapshot(); }
+    QVariantMap guiQueue() const { return HopStats::guiQueue()->snapshot(); }
+    QVariantList bucketBounds() const { return HopStats::bucketBounds(); }
+    bool isEnabled() const { return m_enabled; }
+    void setEnabled(bool enabled);
+    int updateInterval() const { return m_updateInterval; }
+    void setUpdateInterval(int updateInterval);
+
+    Q_INVOKABLE void reset();
+
+Q_SIGNALS:
+    void updated();
+    void enabledChanged(bool isEnabled);
+    void updateIntervalChanged(int newUpdateInterval);
+
+private:
+    void updateTimer();
+
+    bool m_enabled;
+    int m_updateInterval;
+    QTimer m_timer;
+};
+
+#endif
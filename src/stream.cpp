@@ -0,0 +1,653 @@
+#include <frida-core.h>
+
+#include "stream.h"
+
+#include "device.h"
+#include "maincontext.h"
+#include "stats.h"
+
+#include <QFile>
+#include <QMutexLocker>
+
+static const int ReadChunkSize = 256 * 1024;
+
+struct StreamChannel
+{
+    Stream *stream;
+    int generation;
+    GCancellable *cancellable;
+    GIOStream *handle;
+    GOutputStream *fileOutput;
+    int pending;
+};
+
+struct StreamRequest
+{
+    StreamChannel *channel;
+    gpointer source;
+    QByteArray buffer;
+};
+
+Stream::Stream(QObject *parent) :
+    QIODevice(parent),
+    m_active(false),
+    m_status(Status::Closed),
+    m_bytesReceived(0),
+    m_bytesToWrite(0),
+    m_generation(0),
+    m_bufferLimit(4 * 1024 * 1024),
+    m_readPaused(false),
+    m_readyReadPending(false),
+    m_finished(false),
+    m_channel(nullptr),
+    m_reading(false),
+    m_writing(false),
+    m_fileWriting(false),
+    m_eof(false),
+    m_mainContext(new MainContext(frida_get_main_context()))
+{
+    m_progressTimer.setInterval(250);
+    connect(&m_progressTimer, &QTimer::timeout, this, &Stream::updateProgress);
+}
+
+void Stream::dispose()
+{
+    performClose();
+}
+
+Stream::~Stream()
+{
+    m_mainContext->perform([this] () { dispose(); });
+}
+
+void Stream::setDevice(Device *device)
+{
+    if (device == m_device)
+        return;
+
+    m_device = device;
+    Q_EMIT deviceChanged(device);
+
+    if (m_active)
+        update();
+}
+
+void Stream::setAddress(QString address)
+{
+    if (address == m_address)
+        return;
+
+    m_address = address;
+    Q_EMIT addressChanged(address);
+
+    if (m_active)
+        update();
+}
+
+void Stream::setFilePath(QString filePath)
+{
+    if (filePath == m_filePath)
+        return;
+
+    m_filePath = filePath;
+    Q_EMIT filePathChanged(filePath);
+
+    if (m_active)
+        update();
+}
+
+void Stream::setActive(bool active)
+{
+    if (active == m_active)
+        return;
+
+    m_active = active;
+    Q_EMIT activeChanged(active);
+
+    update();
+}
+
+void Stream::setBufferLimit(int bufferLimit)
+{
+    if (bufferLimit == m_bufferLimit || bufferLimit < ReadChunkSize)
+        return;
+
+    bool resume = false;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_bufferLimit = bufferLimit;
+        if (m_readPaused && m_buffer.size() < bufferLimit) {
+            m_readPaused = false;
+            resume = true;
+        }
+    }
+    if (resume)
+        m_mainContext->schedule([this] () { startReading(); });
+
+    Q_EMIT bufferLimitChanged(bufferLimit);
+}
+
+qint64 Stream::bytesAvailable() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_buffer.size() + QIODevice::bytesAvailable();
+}
+
+void Stream::close()
+{
+    setActive(false);
+}
+
+qint64 Stream::readData(char *data, qint64 maxSize)
+{
+    bool resume = false;
+    qint64 size;
+    {
+        QMutexLocker locker(&m_mutex);
+
+        size = qMin<qint64>(maxSize, m_buffer.size());
+        if (size == 0 && m_finished)
+            return -1;
+        memcpy(data, m_buffer.constData(), size);
+        m_buffer.remove(0, size);
+
+        // Resume once half the buffer has drained, not on every read.
+        if (m_readPaused && m_buffer.size() <= m_bufferLimit / 2) {
+            m_readPaused = false;
+            resume = true;
+        }
+    }
+
+    if (resume)
+        m_mainContext->schedule([this] () { startReading(); });
+
+    return size;
+}
+
+qint64 Stream::writeData(const char *data, qint64 maxSize)
+{
+    QByteArray chunk(data, maxSize);
+    m_bytesToWrite += maxSize;
+    m_mainContext->schedule([=] () { performWrite(chunk); });
+    return maxSize;
+}
+
+void Stream::update()
+{
+    FridaDevice *handle = nullptr;
+    if (m_active && !m_device.isNull() && !m_address.isEmpty()) {
+        handle = m_device->handle();
+        g_object_ref(handle);
+    }
+
+    auto generation = ++m_generation;
+    auto address = m_address;
+    auto filePath = m_filePath;
+
+    if (isOpen())
+        QIODevice::close();
+    m_bytesToWrite = 0;
+    m_progressTimer.stop();
+    updateStatus((handle != nullptr) ? Status::Opening : Status::Closed);
+
+    m_mainContext->schedule([=] () {
+        performClose();
+        if (handle != nullptr)
+            performOpen(handle, generation, address, filePath);
+    });
+}
+
+void Stream::updateStatus(Status status)
+{
+    if (status == m_status)
+        return;
+
+    m_status = status;
+    Q_EMIT statusChanged(status);
+}
+
+void Stream::performOpen(FridaDevice *handle, int generation, QString address, QString filePath)
+{
+    m_channel = new StreamChannel { this, generation, g_cancellable_new(), nullptr, nullptr, 0 };
+    m_received.storeRelaxed(0);
+
+    auto request = createRequest(handle);
+    if (!filePath.isEmpty())
+        request->buffer = QFile::encodeName(filePath);
+    frida_device_open_channel(handle, address.toUtf8().constData(), m_channel->cancellable, onOpenReadyWrapper,
+        request);
+    g_object_unref(handle);
+}
+
+void Stream::performClose()
+{
+    m_reading = false;
+    m_writing = false;
+    m_fileWriting = false;
+    m_eof = false;
+    m_writeQueue.clear();
+    m_fileQueue.clear();
+
+    {
+        QMutexLocker locker(&m_mutex);
+        m_buffer.clear();
+        m_readPaused = false;
+        m_readyReadPending = false;
+        m_finished = false;
+    }
+
+    if (m_channel == nullptr)
+        return;
+
+    // Outstanding operations still point at the channel; the last one to
+    // complete closes it.
+    auto channel = m_channel;
+    m_channel = nullptr;
+    channel->stream = nullptr;
+    g_cancellable_cancel(channel->cancellable);
+    if (channel->pending == 0)
+        destroyChannel(channel);
+}
+
+void Stream::performWrite(QByteArray data)
+{
+    if (m_channel == nullptr)
+        return;
+
+    m_writeQueue.enqueue(data);
+    flushWrites();
+}
+
+StreamRequest *Stream::createRequest(gpointer source)
+{
+    m_channel->pending++;
+    return new StreamRequest { m_channel, g_object_ref(source), QByteArray() };
+}
+
+void Stream::finishRequest(StreamRequest *request)
+{
+    auto channel = request->channel;
+    g_object_unref(request->source);
+    delete request;
+
+    channel->pending--;
+    if (channel->stream == nullptr && channel->pending == 0)
+        destroyChannel(channel);
+}
+
+void Stream::destroyChannel(StreamChannel *channel)
+{
+    if (channel->fileOutput != nullptr) {
+        g_output_stream_close_async(channel->fileOutput, G_PRIORITY_DEFAULT, nullptr, nullptr, nullptr);
+        g_object_unref(channel->fileOutput);
+    }
+    if (channel->handle != nullptr) {
+        g_io_stream_close_async(channel->handle, G_PRIORITY_DEFAULT, nullptr, nullptr, nullptr);
+        g_object_unref(channel->handle);
+    }
+    g_object_unref(channel->cancellable);
+    delete channel;
+}
+
+void Stream::onOpenReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    auto request = static_cast<StreamRequest *>(data);
+    auto channel = request->channel;
+
+    // Finish even when closed meanwhile, so the channel gets closed too.
+    GError *error = nullptr;
+    channel->handle = frida_device_open_channel_finish(FRIDA_DEVICE(obj), res, &error);
+
+    auto self = channel->stream;
+    if (self != nullptr) {
+        if (error == nullptr && !request->buffer.isEmpty()) {
+            auto file = g_file_new_for_path(request->buffer.constData());
+            g_file_replace_async(file, nullptr, FALSE, G_FILE_CREATE_REPLACE_DESTINATION, G_PRIORITY_DEFAULT,
+                channel->cancellable, onFileReadyWrapper, self->createRequest(file));
+            g_object_unref(file);
+        } else {
+            self->onOpenReady(error);
+        }
+    }
+    g_clear_error(&error);
+
+    finishRequest(request);
+}
+
+void Stream::onOpenReady(GError *error)
+{
+    if (error != nullptr) {
+        fail("Failed to open channel: ", error);
+        return;
+    }
+
+    invokeQueued(this, "onOpened",
+        Q_ARG(int, m_channel->generation),
+        Q_ARG(bool, m_channel->fileOutput != nullptr));
+
+    startReading();
+    flushWrites();
+}
+
+void Stream::onFileReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    auto request = static_cast<StreamRequest *>(data);
+    auto channel = request->channel;
+
+    GError *error = nullptr;
+    auto fileOutput = g_file_replace_finish(G_FILE(obj), res, &error);
+    if (fileOutput != nullptr)
+        channel->fileOutput = G_OUTPUT_STREAM(fileOutput);
+
+    if (channel->stream != nullptr)
+        channel->stream->onFileReady(error);
+    g_clear_error(&error);
+
+    finishRequest(request);
+}
+
+void Stream::onFileReady(GError *error)
+{
+    if (error != nullptr) {
+        fail("Failed to open file: ", error);
+        return;
+    }
+
+    onOpenReady(nullptr);
+}
+
+void Stream::startReading()
+{
+    if (m_channel == nullptr || m_channel->handle == nullptr || m_reading || m_eof)
+        return;
+
+    {
+        QMutexLocker locker(&m_mutex);
+        if (m_readPaused)
+            return;
+    }
+
+    m_reading = true;
+
+    auto input = g_io_stream_get_input_stream(m_channel->handle);
+    auto request = createRequest(input);
+    request->buffer.resize(ReadChunkSize);
+    g_input_stream_read_async(input, request->buffer.data(), ReadChunkSize, G_PRIORITY_DEFAULT,
+        m_channel->cancellable, onReadReadyWrapper, request);
+}
+
+void Stream::onReadReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<StreamRequest *>(data);
+    if (request->channel->stream != nullptr)
+        request->channel->stream->onReadReady(request, res);
+    finishRequest(request);
+}
+
+void Stream::onReadReady(StreamRequest *request, GAsyncResult *res)
+{
+    m_reading = false;
+
+    GError *error = nullptr;
+    auto size = g_input_stream_read_finish(G_INPUT_STREAM(request->source), res, &error);
+    if (error != nullptr) {
+        fail("Failed to read from channel: ", error);
+        g_error_free(error);
+        return;
+    }
+
+    if (size == 0) {
+        m_eof = true;
+        finishSink();
+        return;
+    }
+
+    m_received.fetchAndAddRelaxed(size);
+    request->buffer.truncate(size);
+
+    // With a file sink, chunks go from one GIO callback to the next and never
+    // reach the GUI thread. One chunk is written while the next is read.
+    if (m_channel->fileOutput != nullptr) {
+        m_fileQueue.enqueue(request->buffer);
+        writeToFile();
+        if (m_fileQueue.size() < 2)
+            startReading();
+        return;
+    }
+
+    bool notify;
+    {
+        QMutexLocker locker(&m_mutex);
+        m_buffer.append(request->buffer);
+        m_readPaused = m_buffer.size() >= m_bufferLimit;
+        notify = !m_readyReadPending;
+        m_readyReadPending = true;
+    }
+
+    if (notify) {
+        invokeQueued(this, "onReadyRead",
+            Q_ARG(int, m_channel->generation));
+    }
+
+    startReading();
+}
+
+void Stream::writeToFile()
+{
+    if (m_fileWriting || m_fileQueue.isEmpty())
+        return;
+
+    m_fileWriting = true;
+
+    auto request = createRequest(m_channel->fileOutput);
+    request->buffer = m_fileQueue.head();
+    g_output_stream_write_all_async(m_channel->fileOutput, request->buffer.constData(), request->buffer.size(),
+        G_PRIORITY_DEFAULT, m_channel->cancellable, onFileWriteReadyWrapper, request);
+}
+
+void Stream::onFileWriteReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<StreamRequest *>(data);
+    if (request->channel->stream != nullptr)
+        request->channel->stream->onFileWriteReady(request, res);
+    finishRequest(request);
+}
+
+void Stream::onFileWriteReady(StreamRequest *request, GAsyncResult *res)
+{
+    m_fileWriting = false;
+
+    GError *error = nullptr;
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(request->source), res, nullptr, &error);
+    if (error != nullptr) {
+        fail("Failed to write to file: ", error);
+        g_error_free(error);
+        return;
+    }
+
+    m_fileQueue.dequeue();
+
+    if (m_eof) {
+        finishSink();
+        return;
+    }
+
+    writeToFile();
+    startReading();
+}
+
+void Stream::flushWrites()
+{
+    if (m_channel->handle == nullptr || m_writing || m_writeQueue.isEmpty())
+        return;
+
+    m_writing = true;
+
+    auto output = g_io_stream_get_output_stream(m_channel->handle);
+    auto request = createRequest(output);
+    request->buffer = m_writeQueue.head();
+    g_output_stream_write_all_async(output, request->buffer.constData(), request->buffer.size(), G_PRIORITY_DEFAULT,
+        m_channel->cancellable, onWriteReadyWrapper, request);
+}
+
+void Stream::onWriteReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<StreamRequest *>(data);
+    if (request->channel->stream != nullptr)
+        request->channel->stream->onWriteReady(request, res);
+    finishRequest(request);
+}
+
+void Stream::onWriteReady(StreamRequest *request, GAsyncResult *res)
+{
+    m_writing = false;
+
+    GError *error = nullptr;
+    g_output_stream_write_all_finish(G_OUTPUT_STREAM(request->source), res, nullptr, &error);
+    if (error != nullptr) {
+        fail("Failed to write to channel: ", error);
+        g_error_free(error);
+        return;
+    }
+
+    m_writeQueue.dequeue();
+    invokeQueued(this, "onBytesWritten",
+        Q_ARG(int, m_channel->generation),
+        Q_ARG(qint64, request->buffer.size()));
+
+    flushWrites();
+}
+
+void Stream::finishSink()
+{
+    auto fileOutput = m_channel->fileOutput;
+    if (fileOutput == nullptr) {
+        {
+            QMutexLocker locker(&m_mutex);
+            m_finished = true;
+        }
+        invokeQueued(this, "onFinished",
+            Q_ARG(int, m_channel->generation));
+        return;
+    }
+
+    if (!m_fileQueue.isEmpty()) {
+        writeToFile();
+        return;
+    }
+
+    m_channel->fileOutput = nullptr;
+    g_output_stream_close_async(fileOutput, G_PRIORITY_DEFAULT, m_channel->cancellable, onFileCloseReadyWrapper,
+        createRequest(fileOutput));
+    g_object_unref(fileOutput);
+}
+
+void Stream::onFileCloseReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data)
+{
+    Q_UNUSED(obj);
+
+    auto request = static_cast<StreamRequest *>(data);
+    if (request->channel->stream != nullptr)
+        request->channel->stream->onFileCloseReady(request, res);
+    finishRequest(request);
+}
+
+void Stream::onFileCloseReady(StreamRequest *request, GAsyncResult *res)
+{
+    GError *error = nullptr;
+    g_output_stream_close_finish(G_OUTPUT_STREAM(request->source), res, &error);
+    if (error != nullptr) {
+        fail("Failed to close file: ", error);
+        g_error_free(error);
+        return;
+    }
+
+    finishSink();
+}
+
+void Stream::fail(const char *prefix, const GError *error)
+{
+    auto message = QString(prefix).append(QString::fromUtf8(error->message));
+
+    invokeQueued(this, "onError",
+        Q_ARG(int, m_channel->generation),
+        Q_ARG(QString, message));
+
+    performClose();
+}
+
+void Stream::onOpened(int generation, bool sink)
+{
+    if (generation != m_generation)
+        return;
+
+    QIODevice::open(sink ? (QIODevice::WriteOnly | QIODevice::Unbuffered) : (QIODevice::ReadWrite | QIODevice::Unbuffered));
+    updateStatus(Status::Open);
+    m_progressTimer.start();
+}
+
+void Stream::onReadyRead(int generation)
+{
+    {
+        QMutexLocker locker(&m_mutex);
+        m_readyReadPending = false;
+    }
+
+    if (generation != m_generation)
+        return;
+
+    Q_EMIT readyRead();
+}
+
+void Stream::onBytesWritten(int generation, qint64 size)
+{
+    if (generation != m_generation)
+        return;
+
+    m_bytesToWrite -= size;
+    Q_EMIT bytesWritten(size);
+}
+
+void Stream::onFinished(int generation)
+{
+    if (generation != m_generation)
+        return;
+
+    m_progressTimer.stop();
+    updateProgress();
+    updateStatus(Status::Finished);
+
+    Q_EMIT readChannelFinished();
+    Q_EMIT finished();
+}
+
+void Stream::onError(int generation, QString message)
+{
+    if (generation != m_generation)
+        return;
+
+    m_progressTimer.stop();
+    updateProgress();
+    setErrorString(message);
+    if (isOpen())
+        QIODevice::close();
+    updateStatus(Status::Error);
+
+    Q_EMIT error(message);
+}
+
+void Stream::updateProgress()
+{
+    auto received = m_received.loadRelaxed();
+    if (received == m_bytesReceived)
+        return;
+
+    m_bytesReceived = received;
+    Q_EMIT bytesReceivedChanged(received);
+}
@@ -0,0 +1,145 @@
+#ifndef FRIDAQML_STREAM_H
+#define FRIDAQML_STREAM_H
+
+#include "fridafwd.h"
+
+#include <QAtomicInteger>
+#include <QIODevice>
+#include <QMutex>
+#include <QPointer>
+#include <QQmlEngine>
+#include <QQueue>
+#include <QTimer>
+
+Q_MOC_INCLUDE("device.h")
+class Device;
+class MainContext;
+struct StreamChannel;
+struct StreamRequest;
+
+class Stream : public QIODevice
+{
+    Q_OBJECT
+    Q_DISABLE_COPY_MOVE(Stream)
+    Q_PROPERTY(Device *device READ device WRITE setDevice NOTIFY deviceChanged)
+    Q_PROPERTY(QString address READ address WRITE setAddress NOTIFY addressChanged)
+    Q_PROPERTY(QString filePath READ filePath WRITE setFilePath NOTIFY filePathChanged)
+    Q_PROPERTY(bool active READ isActive WRITE setActive NOTIFY activeChanged)
+    Q_PROPERTY(int bufferLimit READ bufferLimit WRITE setBufferLimit NOTIFY bufferLimitChanged)
+    Q_PROPERTY(Status status READ status NOTIFY statusChanged)
+    Q_PROPERTY(qint64 bytesReceived READ bytesReceived NOTIFY bytesReceivedChanged)
+    QML_ELEMENT
+
+public:
+    enum class Status { Closed, Opening, Open, Finished, Error };
+    Q_ENUM(Status)
+
+    explicit Stream(QObject *parent = nullptr);
+private:
+    void dispose();
+public:
+    ~Stream();
+
+    Device *device() const { return m_device; }
+    void setDevice(Device *device);
+    QString address() const { return m_address; }
+    void setAddress(QString address);
+    QString filePath() const { return m_filePath; }
+    void setFilePath(QString filePath);
+    bool isActive() const { return m_active; }
+    void setActive(bool active);
+    int bufferLimit() const { return m_bufferLimit; }
+    void setBufferLimit(int bufferLimit);
+    Status status() const { return m_status; }
+    qint64 bytesReceived() const { return m_bytesReceived; }
+
+    Q_INVOKABLE QByteArray readAvailable() { return readAll(); }
+    Q_INVOKABLE qint64 writeBytes(QByteArray data) { return write(data); }
+
+    bool isSequential() const override { return true; }
+    qint64 bytesAvailable() const override;
+    qint64 bytesToWrite() const override { return m_bytesToWrite; }
+    void close() override;
+
+Q_SIGNALS:
+    void deviceChanged(Device *newDevice);
+    void addressChanged(QString newAddress);
+    void filePathChanged(QString newFilePath);
+    void activeChanged(bool newActive);
+    void bufferLimitChanged(int newBufferLimit);
+    void statusChanged(Status newStatus);
+    void bytesReceivedChanged(qint64 newBytesReceived);
+    void finished();
+    void error(QString message);
+
+protected:
+    qint64 readData(char *data, qint64 maxSize) override;
+    qint64 writeData(const char *data, qint64 maxSize) override;
+
+private:
+    void update();
+    void updateStatus(Status status);
+
+    void performOpen(FridaDevice *handle, int generation, QString address, QString filePath);
+    void performClose();
+    void performWrite(QByteArray data);
+    StreamRequest *createRequest(gpointer source);
+    static void finishRequest(StreamRequest *request);
+    static void destroyChannel(StreamChannel *channel);
+    static void onOpenReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onOpenReady(GError *error);
+    static void onFileReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onFileReady(GError *error);
+    void startReading();
+    static void onReadReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onReadReady(StreamRequest *request, GAsyncResult *res);
+    void writeToFile();
+    static void onFileWriteReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onFileWriteReady(StreamRequest *request, GAsyncResult *res);
+    void flushWrites();
+    static void onWriteReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onWriteReady(StreamRequest *request, GAsyncResult *res);
+    void finishSink();
+    static void onFileCloseReadyWrapper(GObject *obj, GAsyncResult *res, gpointer data);
+    void onFileCloseReady(StreamRequest *request, GAsyncResult *res);
+    void fail(const char *prefix, const GError *error);
+
+private Q_SLOTS:
+    void onOpened(int generation, bool sink);
+    void onReadyRead(int generation);
+    void onBytesWritten(int generation, qint64 size);
+    void onFinished(int generation);
+    void onError(int generation, QString message);
+    void updateProgress();
+
+private:
+    QPointer<Device> m_device;
+    QString m_address;
+    QString m_filePath;
+    bool m_active;
+    Status m_status;
+    qint64 m_bytesReceived;
+    qint64 m_bytesToWrite;
+    int m_generation;
+    QTimer m_progressTimer;
+
+    mutable QMutex m_mutex;
+    QByteArray m_buffer;
+    int m_bufferLimit;
+    bool m_readPaused;
+    bool m_readyReadPending;
+    bool m_finished;
+    QAtomicInteger<qint64> m_received;
+
+    StreamChannel *m_channel;
+    bool m_reading;
+    bool m_writing;
+    bool m_fileWriting;
+    bool m_eof;
+    QQueue<QByteArray> m_writeQueue;
+    QQueue<QByteArray> m_fileQueue;
+
+    QScopedPointer<MainContext> m_mainContext;
+};
+
+#endif
@@ -0,0 +1,64 @@
+#include <frida-core.h>
+
+#include "syntheticprocesssource.h"
+
+#include <QMutexLocker>
+
+static const char *SyntheticProcessNames[] = {
+    "bash", "chrome", "Finder", "kworker", "launchd", "nginx", "postgres", "python3",
+    "sshd", "Slack", "systemd", "Xorg",
+};
+
+SyntheticProcessSource::SyntheticProcessSource(int processCount, double churn, int latency, quint32 seed) :
+    m_token(G_OBJECT(g_object_new(G_TYPE_OBJECT, nullptr))),
+    m_processCount(qMax(processCount, 0)),
+    m_churn(qBound(0.0, churn, 1.0)),
+    m_latency(qMax(latency, 0)),
+    m_random(seed),
+    m_nextPid(100),
+    m_populated(false)
+{
+}
+
+SyntheticProcessSource::~SyntheticProcessSource()
+{
+    g_object_unref(m_token);
+}
+
+QList<FridaProcess *> SyntheticProcessSource::enumerate()
+{
+    QMutexLocker locker(&m_mutex);
+
+    if (!m_populated) {
+        m_entries.reserve(m_processCount);
+        for (int i = 0; i != m_processCount; i++)
+            m_entries.append(createEntry());
+        m_populated = true;
+    } else {
+        auto replacements = static_cast<int>(m_entries.size() * m_churn);
+        for (int i = 0; i != replacements; i++)
+            m_entries[m_random.bounded(static_cast<int>(m_entries.size()))] = createEntry();
+    }
+
+    auto parameters = g_hash_table_new_full(g_str_hash, g_str_equal, g_free,
+        reinterpret_cast<GDestroyNotify>(g_variant_unref));
+
+    QList<FridaProcess *> processes;
+    processes.reserve(m_entries.size());
+    for (const Entry &entry : std::as_const(m_entries)) {
+        std::string name = entry.name.toStdString();
+        processes.append(frida_process_new(entry.pid, name.c_str(), parameters));
+    }
+
+    g_hash_table_unref(parameters);
+
+    return processes;
+}
+
+SyntheticProcessSource::Entry SyntheticProcessSource::createEntry()
+{
+    auto name = SyntheticProcessNames[m_random.bounded(static_cast<int>(G_N_ELEMENTS(SyntheticProcessNames)))];
+    auto pid = m_nextPid;
+    m_nextPid += 1 + m_random.bounded(4);
+    return Entry { pid, QString("%1-%2").arg(name).arg(pid) };
+}
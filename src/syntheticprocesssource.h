@@ -0,0 +1,49 @@
+#ifndef FRIDAQML_SYNTHETICPROCESSSOURCE_H
+#define FRIDAQML_SYNTHETICPROCESSSOURCE_H
+
+#include "fridafwd.h"
+
+#include <QList>
+#include <QMutex>
+#include <QRandomGenerator>
+#include <QString>
+
+// Stands in for a device when enumerating processes, so ProcessListModel can
+// be driven with large, churning process sets that are the same on every
+// run. Each enumeration after the first replaces a `churn` fraction of the
+// processes with new ones, and results are handed back after `latency` ms.
+class SyntheticProcessSource
+{
+public:
+    explicit SyntheticProcessSource(int processCount, double churn = 0.0, int latency = 0, quint32 seed = 1);
+    ~SyntheticProcessSource();
+
+    gpointer token() const { return m_token; }
+    int processCount() const { return m_processCount; }
+    double churn() const { return m_churn; }
+    int latency() const { return m_latency; }
+
+    QList<FridaProcess *> enumerate();
+
+private:
+    struct Entry
+    {
+        unsigned int pid;
+        QString name;
+    };
+
+    Entry createEntry();
+
+    GObject *m_token;
+    int m_processCount;
+    double m_churn;
+    int m_latency;
+
+    QMutex m_mutex;
+    QRandomGenerator m_random;
+    QList<Entry> m_entries;
+    unsigned int m_nextPid;
+    bool m_populated;
+};
+
+#endif
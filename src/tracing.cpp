@@ -0,0 +1,193 @@
+#include <frida-core.h>
+
+#include "tracing.h"
+
+#include <memory>
+#include <QAtomicInteger>
+#include <QCoreApplication>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QList>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QThread>
+
+#ifdef FRIDAQML_ENABLE_TRACING
+
+struct TraceEvent
+{
+    const char *name;
+    qint64 startTime;
+    qint64 duration;
+};
+
+// A ring holding each thread's most recent events. Only the owning thread
+// appends, and it publishes each event with a release store of the running
+// count, so exporting never has to stop the recording threads. An export
+// copies what it wants and then drops whatever the owner lapped meanwhile.
+// The count wraps harmlessly, as Capacity divides 2^32.
+struct TraceBuffer
+{
+    static const quint32 Capacity = 1 << 16;
+
+    TraceBuffer(int tid, QString threadName) :
+        tid(tid),
+        threadName(threadName),
+        events(new TraceEvent[Capacity])
+    {
+    }
+
+    int tid;
+    QString threadName;
+    std::unique_ptr<TraceEvent[]> events;
+    QAtomicInteger<quint32> written;
+    QAtomicInteger<quint32> start;
+};
+
+static QMutex buffersMutex;
+static QList<TraceBuffer *> buffers;
+static thread_local TraceBuffer *currentBuffer = nullptr;
+
+static TraceBuffer *registerCurrentThread()
+{
+    QString threadName;
+    auto thread = QThread::currentThread();
+    if (qApp != nullptr && thread == qApp->thread())
+        threadName = QStringLiteral("GUI");
+    else if (!thread->objectName().isEmpty())
+        threadName = thread->objectName();
+
+    QMutexLocker locker(&buffersMutex);
+    int tid = buffers.size() + 1;
+    if (threadName.isEmpty())
+        threadName = QStringLiteral("Thread %1").arg(tid);
+    // Buffers outlive their threads so an export can still include them.
+    auto buffer = new TraceBuffer(tid, threadName);
+    buffers.append(buffer);
+    return buffer;
+}
+
+bool Tracer::isEnabled()
+{
+    return true;
+}
+
+qint64 Tracer::now()
+{
+    return g_get_monotonic_time();
+}
+
+void Tracer::record(const char *name, qint64 startTime, qint64 endTime)
+{
+    if (currentBuffer == nullptr)
+        currentBuffer = registerCurrentThread();
+
+    quint32 count = currentBuffer->written.loadRelaxed();
+    currentBuffer->events[count % TraceBuffer::Capacity] = { name, startTime, endTime - startTime };
+    currentBuffer->written.storeRelease(count + 1);
+}
+
+void Tracer::clear()
+{
+    QMutexLocker locker(&buffersMutex);
+    for (auto buffer : std::as_const(buffers))
+        buffer->start.storeRelaxed(buffer->written.loadAcquire());
+}
+
+bool Tracer::exportChromeTrace(QString path, QString *errorMessage)
+{
+    QJsonArray events;
+
+    {
+        QMutexLocker locker(&buffersMutex);
+        for (auto buffer : std::as_const(buffers)) {
+            events.append(QJsonObject {
+                { "name", "thread_name" },
+                { "ph", "M" },
+                { "pid", 1 },
+                { "tid", buffer->tid },
+                { "args", QJsonObject { { "name", buffer->threadName } } },
+            });
+
+            quint32 end = buffer->written.loadAcquire();
+            quint32 begin = buffer->start.loadRelaxed();
+            if (end - begin > TraceBuffer::Capacity)
+                begin = end - TraceBuffer::Capacity;
+
+            QList<TraceEvent> snapshot;
+            snapshot.reserve(end - begin);
+            for (quint32 i = begin; i != end; i++)
+                snapshot.append(buffer->events[i % TraceBuffer::Capacity]);
+
+            // The owner may already be writing the slot after the last one
+            // it published, which is where the oldest copied event lived.
+            quint32 ahead = buffer->written.loadAcquire() + 1 - begin;
+            qsizetype lapped = (ahead > TraceBuffer::Capacity) ? ahead - TraceBuffer::Capacity : 0;
+
+            for (qsizetype i = qMin(lapped, snapshot.size()); i != snapshot.size(); i++) {
+                const auto &event = snapshot[i];
+                events.append(QJsonObject {
+                    { "name", event.name },
+                    { "ph", "X" },
+                    { "pid", 1 },
+                    { "tid", buffer->tid },
+                    { "ts", event.startTime },
+                    { "dur", event.duration },
+                });
+            }
+        }
+    }
+
+    QJsonObject trace {
+        { "traceEvents", events },
+        { "displayTimeUnit", "ms" },
+    };
+
+    QSaveFile file(path);
+    if (!file.open(QIODevice::WriteOnly)) {
+        *errorMessage = file.errorString();
+        return false;
+    }
+    file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact));
+    if (!file.commit()) {
+        *errorMessage = file.errorString();
+        return false;
+    }
+
+    return true;
+}
+
+#else
+
+bool Tracer::isEnabled()
+{
+    return false;
+}
+
+qint64 Tracer::now()
+{
+    return g_get_monotonic_time();
+}
+
+void Tracer::record(const char *name, qint64 startTime, qint64 endTime)
+{
+    Q_UNUSED(name);
+    Q_UNUSED(startTime);
+    Q_UNUSED(endTime);
+}
+
+void Tracer::clear()
+{
+}
+
+bool Tracer::exportChromeTrace(QString path, QString *errorMessage)
+{
+    Q_UNUSED(path);
+
+    *errorMessage = QStringLiteral("Tracing is not enabled in this build; reconfigure with -Dtracing=true");
+    return false;
+}
+
+#endif
@@ -0,0 +1,41 @@
+#ifndef FRIDAQML_TRACING_H
+#define FRIDAQML_TRACING_H
+
+#include <QString>
+
+class Tracer
+{
+public:
+    static bool isEnabled();
+    static qint64 now();
+
+    // Names must have static storage duration; they are stored by pointer.
+    static void record(const char *name, qint64 startTime, qint64 endTime);
+    static void clear();
+    static bool exportChromeTrace(QString path, QString *errorMessage);
+
+    class Span
+    {
+    public:
+        explicit Span(const char *name) : m_name(name), m_startTime(Tracer::now()) {}
+        ~Span() { Tracer::record(m_name, m_startTime, Tracer::now()); }
+
+    private:
+        Q_DISABLE_COPY_MOVE(Span)
+
+        const char *m_name;
+        qint64 m_startTime;
+    };
+};
+
+#ifdef FRIDAQML_ENABLE_TRACING
+# define FRIDAQML_TRACE_CONCAT_(a, b) a##b
+# define FRIDAQML_TRACE_CONCAT(a, b) FRIDAQML_TRACE_CONCAT_(a, b)
+# define FRIDAQML_TRACE_SCOPE(name) Tracer::Span FRIDAQML_TRACE_CONCAT(fridaqmlTraceSpan, __LINE__)(name)
+# define FRIDAQML_TRACE_SINCE(name, startTime) Tracer::record(name, startTime, Tracer::now())
+#else
+# define FRIDAQML_TRACE_SCOPE(name) do {} while (false)
+# define FRIDAQML_TRACE_SINCE(name, startTime) do {} while (false)
+#endif
+
+#endif